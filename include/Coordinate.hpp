@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Step between two neighbouring grid cells.
+struct Offset final
+{
+    int32_t row{};
+    int32_t col{};
+};
+
+// Same order as Cursor::Direction: up, right, down, left.
+inline constexpr std::array<Offset, 4> gDirections{{{-1, 0}, {0, 1}, {1, 0}, {0, -1}}};
+
+// Grid cell packed into 32 bits (16-bit row and column), for grids below 65536 cells per side.
+struct PackedCoord final
+{
+    static constexpr uint32_t gMaxSide{1u << 16};
+
+    uint16_t row{};
+    uint16_t col{};
+
+    constexpr PackedCoord() = default;
+
+    constexpr PackedCoord(uint32_t argRow, uint32_t argCol) noexcept
+    : row{static_cast<uint16_t>(argRow)}
+    , col{static_cast<uint16_t>(argCol)}
+    {}
+};
+
+static_assert(sizeof(PackedCoord) == 4);
+
+// Maps the cells of a rows x cols grid to linear indices and back.
+class GridIndexer final
+{
+public:
+    constexpr GridIndexer() = default;
+
+    constexpr GridIndexer(uint32_t rows, uint32_t cols) noexcept : m_rows{rows}, m_cols{cols} {}
+
+    // Whether PackedCoord can address every cell of the grid.
+    [[nodiscard]] constexpr bool packable() const noexcept {
+        return m_rows <= PackedCoord::gMaxSide && m_cols <= PackedCoord::gMaxSide;
+    }
+
+    [[nodiscard]] constexpr uint32_t rows() const noexcept {
+        return m_rows;
+    }
+
+    [[nodiscard]] constexpr uint32_t cols() const noexcept {
+        return m_cols;
+    }
+
+    [[nodiscard]] constexpr size_t size() const noexcept {
+        return size_t{m_rows} * m_cols;
+    }
+
+    [[nodiscard]] constexpr bool inRange(int64_t row, int64_t col) const noexcept {
+        return row >= 0 && col >= 0 && row < m_rows && col < m_cols;
+    }
+
+    [[nodiscard]] constexpr uint32_t index(uint32_t row, uint32_t col) const noexcept {
+        return row * m_cols + col;
+    }
+
+    [[nodiscard]] constexpr uint32_t index(PackedCoord coord) const noexcept {
+        return index(coord.row, coord.col);
+    }
+
+    [[nodiscard]] constexpr PackedCoord coord(uint32_t index) const noexcept {
+        return PackedCoord{index / m_cols, index % m_cols};
+    }
+
+    // Writes the neighbour of `coord` in the given direction. Returns false if it is outside the grid.
+    [[nodiscard]] constexpr bool neighbour(PackedCoord coord, Offset offset, PackedCoord& result) const noexcept {
+        const int64_t row{int64_t{coord.row} + offset.row};
+        const int64_t col{int64_t{coord.col} + offset.col};
+        if(!inRange(row, col)) return false;
+        result = PackedCoord{static_cast<uint32_t>(row), static_cast<uint32_t>(col)};
+        return true;
+    }
+
+private:
+    uint32_t m_rows{};
+    uint32_t m_cols{};
+};
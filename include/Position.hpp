@@ -1,5 +1,8 @@
 #pragma once
 
+#include <compare>
+#include <cstdint>
+
 struct Position final
 {
     int64_t x{};
@@ -11,4 +14,6 @@ struct Position final
     [[nodiscard]] constexpr bool inRange(int64_t rows, int64_t cols) const noexcept {
         return x >= 0 && x < rows && y >= 0 && y < cols;
     }
+
+    constexpr auto operator<=>(const Position&) const noexcept = default;
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file.
+// The content stays valid for the lifetime of the object.
+class MappedFile final
+{
+public:
+    explicit MappedFile(std::string_view filename) {
+        const std::string path{filename};
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            throw std::runtime_error{"Failed to open file: " + path};
+        }
+
+        struct stat info{};
+        if(::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error{"Failed to stat file: " + path};
+        }
+
+        m_size = static_cast<size_t>(info.st_size);
+        if(m_size > 0) {
+            void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error{"Failed to map file: " + path};
+            }
+            ::madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(data);
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if(m_data != nullptr) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+
+    [[nodiscard]] std::string_view view() const noexcept {
+        return {m_data, m_size};
+    }
+
+private:
+    const char* m_data{};
+    size_t m_size{};
+};
@@ -1,20 +1,174 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
 
-[[nodiscard]] constexpr size_t numOfDigits(uint64_t num) noexcept {
-    return static_cast<uint64_t>(std::log10(num) + 1);
+__extension__ using int128_t = __int128;
+__extension__ using uint128_t = unsigned __int128;
+
+template<typename T>
+concept UnsignedNumber = std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t> || std::is_same_v<T, uint128_t>;
+
+namespace detail {
+
+// Number of decimal digits of the largest value of T.
+template<UnsignedNumber T>
+inline constexpr size_t gMaxDigits = sizeof(T) == 4 ? 10 : sizeof(T) == 8 ? 20 : 39;
+
+// 10^0 ... 10^(gMaxDigits - 1). 10^gMaxDigits does not fit into T.
+template<UnsignedNumber T>
+inline constexpr auto gPowersOfTen = [] {
+    std::array<T, gMaxDigits<T>> powers{};
+    T power{1};
+    for(auto& value : powers) {
+        value = power;
+        power *= 10;
+    }
+    return powers;
+}();
+
+template<UnsignedNumber T>
+[[nodiscard]] constexpr size_t bitWidth(T num) noexcept {
+    if constexpr (sizeof(T) > sizeof(uint64_t)) {
+        const auto high = static_cast<uint64_t>(num >> 64);
+        return high != 0 ? 64 + bitWidth(high) : bitWidth(static_cast<uint64_t>(num));
+    }
+    else {
+        return num == 0 ? 0 : static_cast<size_t>(std::numeric_limits<uint64_t>::digits - __builtin_clzll(num));
+    }
+}
+
+} // namespace detail
+
+template<UnsignedNumber T>
+[[nodiscard]] constexpr T powerOfTen(size_t exponent) noexcept {
+    return detail::gPowersOfTen<T>[exponent];
 }
 
-[[nodiscard]] constexpr std::pair<uint64_t, uint64_t> splitNum(uint64_t num, size_t countOfDigits) noexcept {
+// Number of decimal digits, 1 for zero.
+// log10(2) ~ 1233 / 4096 turns the bit width into a guess that is at most one digit short.
+// Setting the lowest bit maps zero to one and never crosses a power of ten.
+template<UnsignedNumber T>
+[[nodiscard]] constexpr size_t numOfDigits(T num) noexcept {
+    const T value{static_cast<T>(num | 1)};
+    const size_t guess{(detail::bitWidth<T>(value) * 1233) >> 12};
+    return guess + (value >= detail::gPowersOfTen<T>[guess]);
+}
+
+template<UnsignedNumber T>
+[[nodiscard]] constexpr std::pair<T, T> splitNum(T num, size_t countOfDigits) noexcept {
     // Calculate the power of 10 to split the number
-    const uint64_t splitPoint = countOfDigits / 2;
-    const uint64_t divisor = static_cast<uint64_t>(std::pow(10, splitPoint));
+    const T divisor{powerOfTen<T>(countOfDigits / 2)};
 
     // Split the number
-    const uint64_t firstPart = num / divisor;
-    const uint64_t secondPart = num % divisor;
+    const T firstPart = num / divisor;
+    const T secondPart = num % divisor;
 
     return {firstPart, secondPart};
-}
\ No newline at end of file
+}
+
+// Appends the digits of `suffix` to `prefix`. The caller must make sure the result fits into T.
+template<UnsignedNumber T>
+[[nodiscard]] constexpr T concatenate(T prefix, T suffix) noexcept {
+    return prefix * powerOfTen<T>(numOfDigits(suffix)) + suffix;
+}
+
+// std::ostream has no overloads for 128-bit integers.
+[[nodiscard]] inline std::string toString(uint128_t num) {
+    std::string digits;
+    do {
+        digits.push_back(static_cast<char>('0' + static_cast<int>(num % 10)));
+        num /= 10;
+    } while(num != 0);
+    return {digits.rbegin(), digits.rend()};
+}
+
+[[nodiscard]] inline std::string toString(int128_t num) {
+    const auto magnitude{num < 0 ? uint128_t{0} - static_cast<uint128_t>(num) : static_cast<uint128_t>(num)};
+    return num < 0 ? "-" + toString(magnitude) : toString(magnitude);
+}
+
+namespace detail {
+
+// Checks every power-of-ten boundary of T: 10^k - 1 has k digits and 10^k has k + 1.
+template<UnsignedNumber T>
+[[nodiscard]] consteval bool checkDigitBoundaries() {
+    if(numOfDigits(T{0}) != 1 || numOfDigits(T{1}) != 1 || numOfDigits(static_cast<T>(~T{0})) != gMaxDigits<T>) {
+        return false;
+    }
+    for(size_t k = 1; k < gMaxDigits<T>; ++k) {
+        const T power{gPowersOfTen<T>[k]};
+        if(numOfDigits(T(power - 1)) != k || numOfDigits(power) != k + 1 || numOfDigits(T(power + 1)) != k + 1) {
+            return false;
+        }
+        if(k + 1 < gMaxDigits<T> && splitNum(T(power * 10 - 1), k + 1) != std::pair{T(gPowersOfTen<T>[(k + 1) - (k + 1) / 2] - 1), T(gPowersOfTen<T>[(k + 1) / 2] - 1)}) {
+            return false;
+        }
+    }
+    return concatenate(T{12}, T{345}) == T{12345} && concatenate(T{7}, T{0}) == T{70} && concatenate(T{1}, T{10}) == T{110};
+}
+
+static_assert(checkDigitBoundaries<uint32_t>());
+static_assert(checkDigitBoundaries<uint64_t>());
+static_assert(checkDigitBoundaries<uint128_t>());
+
+} // namespace detail
+
+// Modular arithmetic. The modulus has to be below 2^63, so the sum of two residues never overflows.
+[[nodiscard]] constexpr uint64_t mulMod(uint64_t a, uint64_t b, uint64_t modulus) noexcept {
+    return static_cast<uint64_t>(uint128_t{a} * b % modulus);
+}
+
+[[nodiscard]] constexpr uint64_t powMod(uint64_t base, uint64_t exponent, uint64_t modulus) noexcept {
+    uint64_t result{1 % modulus};
+    for(base %= modulus; exponent != 0; exponent >>= 1) {
+        if(exponent & 1) {
+            result = mulMod(result, base, modulus);
+        }
+        base = mulMod(base, base, modulus);
+    }
+    return result;
+}
+
+// Deterministic Miller-Rabin. The first twelve primes as bases are enough for every 64-bit number.
+[[nodiscard]] constexpr bool isPrime(uint64_t num) noexcept {
+    constexpr std::array<uint64_t, 12> bases{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    if(num < 2) {
+        return false;
+    }
+    for(const auto base : bases) {
+        if(num % base == 0) {
+            return num == base;
+        }
+    }
+
+    const auto trailingZeros{__builtin_ctzll(num - 1)};
+    const uint64_t odd{(num - 1) >> trailingZeros};
+    for(const auto base : bases) {
+        uint64_t value{powMod(base, odd, num)};
+        if(value == 1 || value == num - 1) {
+            continue;
+        }
+        bool composite{true};
+        for(int round = 1; round < trailingZeros && composite; ++round) {
+            value = mulMod(value, value, num);
+            composite = value != num - 1;
+        }
+        if(composite) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace detail {
+
+static_assert(isPrime(2) && isPrime(37) && isPrime(998244353) && isPrime((uint64_t{1} << 61) - 1));
+static_assert(!isPrime(0) && !isPrime(1) && !isPrime(561) && !isPrime(3215031751) && !isPrime(uint64_t{998244353} * 3));
+
+} // namespace detail
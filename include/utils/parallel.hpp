@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+[[nodiscard]] inline size_t hardwareThreads() noexcept {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Calls fn(index, worker) for every index in [0, count).
+// Indices are handed out one by one from a shared counter, so uneven work is balanced dynamically.
+// `worker` is in [0, workers) and can be used to address per-thread scratch data.
+// The first exception thrown by fn is rethrown in the calling thread.
+template<typename Fn>
+void parallelFor(size_t count, Fn&& fn, size_t workers = hardwareThreads())
+{
+    workers = std::max<size_t>(1, std::min(workers, count));
+    if(workers == 1) {
+        for(size_t index = 0; index < count; ++index) {
+            fn(index, size_t{});
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto run = [&](size_t worker) {
+        try {
+            for(size_t index = next++; index < count; index = next++) {
+                fn(index, worker);
+            }
+        }
+        catch(...) {
+            next = count;
+            const std::lock_guard lock{errorMutex};
+            if(!error) error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for(size_t worker = 1; worker < workers; ++worker) {
+        threads.emplace_back(run, worker);
+    }
+    run(0);
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
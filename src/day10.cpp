@@ -1,89 +1,337 @@
 #include "common_headers.hpp"
-#include <queue>
-#include <set>
+#include "Coordinate.hpp"
+#include "utils/mapped_file.hpp"
+#include "utils/parallel.hpp"
 
+#include <bit>
+#include <cctype>
+#include <chrono>
 
-[[nodiscard]] size_t solveFirstPart(const std::vector<std::string>& map)
+#include <sys/resource.h>
+
+
+[[nodiscard]] GridIndexer makeGrid(const std::vector<std::string>& map)
 {
-    size_t totalScore{};
-    int dirs[] = {0, 1, 0, -1, 0};
-    std::queue<std::pair<int, int>> bfs;
-
-    std::set<std::pair<int, int>> uniqueHeights;
-    for(size_t r = 0; r < map.size(); ++r) {
-        for(size_t c = 0; c < map[0].size(); ++c) {
-            if(map[r][c] != '0') continue;
-            uniqueHeights.clear();
-            bfs.emplace(r, c);
-            while(!bfs.empty()) {
-                const auto [row, col] = bfs.front();
-                bfs.pop();
-                if(map[row][col] == '9') {
-                    uniqueHeights.emplace(row, col);
-                }
-                else {
-                    for(size_t idir = 0; idir < 4; ++idir) {
-                        const int new_row{row + dirs[idir]};
-                        const int new_col{col + dirs[idir + 1]};
-
-                        if(new_row < 0 || new_row >= map.size() || new_col < 0 || new_col >= map[0].size()) {
-                            continue;
-                        }
-                        if(map[new_row][new_col] - map[row][col] == 1) {
-                            bfs.emplace(new_row, new_col);
-                        }
-                    }
-                }
+    const GridIndexer grid{static_cast<uint32_t>(map.size()), static_cast<uint32_t>(map.empty() ? 0 : map[0].size())};
+    if(!grid.packable()) {
+        throw std::logic_error{"The map is too large"};
+    }
+    return grid;
+}
+
+// Flat indices of the cells of every height. Cells that are not digits belong to no level.
+using HeightLevels = std::array<std::vector<uint32_t>, 10>;
+
+[[nodiscard]] HeightLevels makeLevels(const std::vector<std::string>& map, const GridIndexer& grid)
+{
+    HeightLevels levels;
+    for(uint32_t r = 0; r < grid.rows(); ++r) {
+        for(uint32_t c = 0; c < grid.cols(); ++c) {
+            if(std::isdigit(static_cast<unsigned char>(map[r][c]))) {
+                levels[static_cast<size_t>(map[r][c] - '0')].push_back(grid.index(r, c));
             }
-            totalScore += uniqueHeights.size();
         }
     }
-    return totalScore;
+    return levels;
+}
+
+// Calls onStep(next, offset) for every neighbour of `cell` that is exactly one step higher.
+template<typename StepHandler>
+void forEachUphill(const std::vector<std::string>& map, const GridIndexer& grid, uint32_t cell, StepHandler&& onStep)
+{
+    const PackedCoord coord{grid.coord(cell)};
+    const char height{map[coord.row][coord.col]};
+    for(const auto offset : gDirections) {
+        PackedCoord next;
+        if(grid.neighbour(coord, offset, next) && map[next.row][next.col] - height == 1) {
+            onStep(grid.index(next), offset);
+        }
+    }
+}
+
+// A trail has exactly 9 steps, so everything a trailhead can reach lies within 9 cells of it.
+constexpr int32_t gTrailLength{9};
+
+// Summits reachable from a cell, stored relative to the cell in a 19 x 19 box.
+// Moving to a neighbour only shifts the box by a row or a column, which is a plain bit shift.
+// A cell of height h only holds summits within 9 - h, so a shifted set never wraps around a box row.
+class RelativeSummits final
+{
+public:
+    [[nodiscard]] static RelativeSummits self() noexcept {
+        RelativeSummits summits;
+        summits.set(gTrailLength * gSide + gTrailLength);
+        return summits;
+    }
+
+    // Adds the summits of the neighbour at `offset` from this cell.
+    void merge(const RelativeSummits& neighbour, Offset offset) noexcept {
+        const int32_t shift{offset.row * gSide + offset.col};
+        for(size_t id = 0; id < gWords; ++id) {
+            m_words[id] |= shift > 0 ? neighbour.shiftedLeft(id, shift) : neighbour.shiftedRight(id, -shift);
+        }
+    }
+
+    [[nodiscard]] size_t count() const noexcept {
+        return std::accumulate(m_words.begin(), m_words.end(), size_t{}, [](size_t sum, uint64_t word) {
+            return sum + static_cast<size_t>(std::popcount(word));
+        });
+    }
+
+private:
+    static constexpr int32_t gSide{2 * gTrailLength + 1};
+    static constexpr size_t gWords{(gSide * gSide + 63) / 64};
+
+    void set(int32_t bit) noexcept {
+        m_words[static_cast<size_t>(bit / 64)] |= uint64_t{1} << (bit % 64);
+    }
+
+    // Word `id` of the whole set shifted towards higher bits. Shifts are shorter than a word.
+    [[nodiscard]] uint64_t shiftedLeft(size_t id, int32_t shift) const noexcept {
+        const uint64_t carry{id > 0 ? m_words[id - 1] >> (64 - shift) : 0};
+        return (m_words[id] << shift) | carry;
+    }
+
+    [[nodiscard]] uint64_t shiftedRight(size_t id, int32_t shift) const noexcept {
+        const uint64_t carry{id + 1 < gWords ? m_words[id + 1] << (64 - shift) : 0};
+        return (m_words[id] >> shift) | carry;
+    }
+
+    std::array<uint64_t, gWords> m_words{};
+};
+
+// Position of every cell within its level, which is also its row in the level's storage.
+[[nodiscard]] std::vector<uint32_t> makeSlots(const GridIndexer& grid, const HeightLevels& levels)
+{
+    std::vector<uint32_t> slots(grid.size());
+    for(const auto& level : levels) {
+        for(uint32_t slot = 0; slot < level.size(); ++slot) {
+            slots[level[slot]] = slot;
+        }
+    }
+    return slots;
 }
 
+// Propagates the reachable summits from height 9 down to 0. Only two consecutive levels are alive at a time.
+// The summit sets have a fixed size, so the work is linear in the size of the map.
+[[nodiscard]] size_t solveFirstPart(const std::vector<std::string>& map)
+{
+    const GridIndexer grid{makeGrid(map)};
+    const HeightLevels levels{makeLevels(map, grid)};
+    const std::vector<uint32_t> slots{makeSlots(grid, levels)};
+
+    std::vector<RelativeSummits> upper(levels[9].size(), RelativeSummits::self());
+    std::vector<RelativeSummits> lower;
+    for(size_t height = 9; height-- > 0;) {
+        lower.assign(levels[height].size(), RelativeSummits{});
+        for(size_t slot = 0; slot < levels[height].size(); ++slot) {
+            forEachUphill(map, grid, levels[height][slot], [&](uint32_t next, Offset offset) {
+                lower[slot].merge(upper[slots[next]], offset);
+            });
+        }
+        std::swap(upper, lower);
+    }
+
+    return std::accumulate(upper.begin(), upper.end(), size_t{}, [](size_t sum, const RelativeSummits& summits) {
+        return sum + summits.count();
+    });
+}
 
+// The rating of a cell is the sum of the ratings of its uphill neighbours, so one pass over the levels is enough.
 [[nodiscard]] size_t solveSecondPart(const std::vector<std::string>& map)
 {
+    const GridIndexer grid{makeGrid(map)};
+    const HeightLevels levels{makeLevels(map, grid)};
+
+    std::vector<size_t> paths(grid.size());
+    for(const auto cell : levels[9]) {
+        paths[cell] = 1;
+    }
+    for(size_t height = 9; height-- > 0;) {
+        for(const auto cell : levels[height]) {
+            forEachUphill(map, grid, cell, [&](uint32_t next, Offset) {
+                paths[cell] += paths[next];
+            });
+        }
+    }
+
     size_t totalRating{};
-    int dirs[] = {0, 1, 0, -1, 0};
-    std::queue<std::pair<int, int>> bfs;
-
-    for(size_t r = 0; r < map.size(); ++r) {
-        for(size_t c = 0; c < map[0].size(); ++c) {
-            if(map[r][c] != '0') continue;
-
-            bfs.emplace(r, c);
-            while(!bfs.empty()) {
-                const auto [row, col] = bfs.front();
-                bfs.pop();
-                if(map[row][col] == '9') {
-                    ++totalRating;
-                }
-                else {
-                    for(size_t idir = 0; idir < 4; ++idir) {
-                        const int new_row{row + dirs[idir]};
-                        const int new_col{col + dirs[idir + 1]};
-
-                        if(new_row < 0 || new_row >= map.size() || new_col < 0 || new_col >= map[0].size()) {
-                            continue;
-                        }
-                        if(map[new_row][new_col] - map[row][col] == 1) {
-                            bfs.emplace(new_row, new_col);
-                        }
-                    }
-                }
+    for(const auto cell : levels[0]) {
+        totalRating += paths[cell];
+    }
+    return totalRating;
+}
+
+
+// Maps that are too large for one thread and for vector<string>. The file is mapped and cut into tiles.
+// Everything a trailhead can reach lies within gTrailLength cells of it.
+// Each tile is therefore solved on its own together with a 9 cell halo read from its neighbours.
+namespace tiled {
+
+constexpr size_t gTileSide{256};
+
+// Row-major view of the mapped input. Rows end with '\n' (or "\r\n").
+class HeightMap final
+{
+public:
+    explicit HeightMap(std::string_view data) : m_data{data} {
+        m_cols = m_data.find('\n');
+        if(m_cols == std::string_view::npos) {
+            m_cols = m_data.size();
+        }
+        m_stride = m_cols + 1;
+        if(m_cols > 0 && m_data[m_cols - 1] == '\r') {
+            --m_cols;
+        }
+
+        // Line breaks after the last row are optional, but the row itself must be as long as the others.
+        const auto content{m_data.substr(0, m_data.find_last_not_of("\r\n") + 1)};
+        if((content.size() + m_stride - m_cols) % m_stride != 0) {
+            throw std::logic_error{"Rows of the map differ in length"};
+        }
+        m_rows = (content.size() + m_stride - m_cols) / m_stride;
+        for(size_t row = 0; row + 1 < m_rows; ++row) {
+            if(m_data[row * m_stride + m_stride - 1] != '\n') {
+                throw std::logic_error{"Rows of the map differ in length"};
             }
         }
     }
-    return totalRating;
+
+    [[nodiscard]] size_t rows() const noexcept {
+        return m_rows;
+    }
+
+    [[nodiscard]] size_t cols() const noexcept {
+        return m_cols;
+    }
+
+    [[nodiscard]] char at(size_t row, size_t col) const noexcept {
+        return m_data[row * m_stride + col];
+    }
+
+private:
+    std::string_view m_data;
+    size_t m_rows{};
+    size_t m_cols{};
+    size_t m_stride{};
+};
+
+struct Totals
+{
+    size_t score{};
+    size_t rating{};
+};
+
+// Per-worker buffers, reused for every tile the worker takes.
+struct TileScratch
+{
+    std::vector<uint32_t> order;
+    std::array<size_t, 11> levelStarts{};
+    std::vector<size_t> paths;
+    std::vector<RelativeSummits> summits;
+};
+
+[[nodiscard]] Totals solveTile(const HeightMap& map, size_t tileRow, size_t tileCol, TileScratch& scratch)
+{
+    const size_t coreTop{tileRow * gTileSide};
+    const size_t coreLeft{tileCol * gTileSide};
+    const size_t coreBottom{std::min(map.rows(), coreTop + gTileSide)};
+    const size_t coreRight{std::min(map.cols(), coreLeft + gTileSide)};
+
+    constexpr auto halo{static_cast<size_t>(gTrailLength)};
+    const size_t top{coreTop - std::min(coreTop, halo)};
+    const size_t left{coreLeft - std::min(coreLeft, halo)};
+    const size_t rows{std::min(map.rows(), coreBottom + halo) - top};
+    const size_t cols{std::min(map.cols(), coreRight + halo) - left};
+
+    const auto height = [&](size_t local) {
+        const char cell{map.at(top + local / cols, left + local % cols)};
+        return std::isdigit(static_cast<unsigned char>(cell)) ? cell - '0' : -1;
+    };
+
+    // Counting sort of the region by height.
+    auto& starts = scratch.levelStarts;
+    starts.fill(0);
+    for(size_t local = 0; local < rows * cols; ++local) {
+        if(const int h{height(local)}; h >= 0) {
+            ++starts[static_cast<size_t>(h) + 1];
+        }
+    }
+    std::partial_sum(starts.begin(), starts.end(), starts.begin());
+    scratch.order.resize(starts.back());
+    auto fill{starts};
+    for(size_t local = 0; local < rows * cols; ++local) {
+        if(const int h{height(local)}; h >= 0) {
+            scratch.order[fill[static_cast<size_t>(h)]++] = static_cast<uint32_t>(local);
+        }
+    }
+
+    scratch.paths.assign(rows * cols, 0);
+    scratch.summits.assign(rows * cols, RelativeSummits{});
+
+    Totals totals;
+    for(size_t h = 10; h-- > 0;) {
+        for(size_t id = starts[h]; id < starts[h + 1]; ++id) {
+            const uint32_t local{scratch.order[id]};
+            const auto row{static_cast<int64_t>(local / cols)};
+            const auto col{static_cast<int64_t>(local % cols)};
+
+            if(h == 9) {
+                scratch.paths[local] = 1;
+                scratch.summits[local] = RelativeSummits::self();
+                continue;
+            }
+            for(const auto offset : gDirections) {
+                const int64_t nextRow{row + offset.row};
+                const int64_t nextCol{col + offset.col};
+                if(nextRow < 0 || nextCol < 0 || nextRow >= static_cast<int64_t>(rows) || nextCol >= static_cast<int64_t>(cols)) continue;
+
+                const auto next{static_cast<size_t>(nextRow) * cols + static_cast<size_t>(nextCol)};
+                if(height(next) != static_cast<int>(h) + 1) continue;
+                scratch.paths[local] += scratch.paths[next];
+                scratch.summits[local].merge(scratch.summits[next], offset);
+            }
+
+            const size_t mapRow{top + static_cast<size_t>(row)};
+            const size_t mapCol{left + static_cast<size_t>(col)};
+            const bool inCore{mapRow >= coreTop && mapRow < coreBottom && mapCol >= coreLeft && mapCol < coreRight};
+            if(h == 0 && inCore) {
+                totals.score += scratch.summits[local].count();
+                totals.rating += scratch.paths[local];
+            }
+        }
+    }
+    return totals;
+}
+
+[[nodiscard]] Totals solve(const HeightMap& map)
+{
+    const size_t tileRows{(map.rows() + gTileSide - 1) / gTileSide};
+    const size_t tileCols{(map.cols() + gTileSide - 1) / gTileSide};
+
+    const size_t workers{std::max<size_t>(1, std::min(hardwareThreads(), tileRows * tileCols))};
+    std::vector<TileScratch> scratches(workers);
+    std::vector<Totals> totals(workers);
+    parallelFor(tileRows * tileCols, [&](size_t tile, size_t worker) {
+        const Totals tileTotals{solveTile(map, tile / tileCols, tile % tileCols, scratches[worker])};
+        totals[worker].score += tileTotals.score;
+        totals[worker].rating += tileTotals.rating;
+    }, workers);
+
+    return std::accumulate(totals.begin(), totals.end(), Totals{}, [](Totals sum, const Totals& part) {
+        return Totals{sum.score + part.score, sum.rating + part.rating};
+    });
 }
 
+} // namespace tiled
+
 
 void printHelp()
 {
     std::cerr << "\nUsage:\n"
-    << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day7 part1 data/day7.txt";
+    << "The program requires 2 args: (part1, part2, tiled) and the path to the file."
+    << "\ntiled solves both parts on all cores and reports the time and the peak memory."
+    << "\nFor example, ./day10 part1 data/day10.txt";
 }
 
 int main(int argc, char* argv[])
@@ -94,20 +342,47 @@ int main(int argc, char* argv[])
     }
 
     std::string_view task{argv[1]};
-    if(task != "part1" && task != "part2") {
-        std::cerr << "\nfirst arg can be either `part1` or `part2`\n";
+    if(task != "part1" && task != "part2" && task != "tiled") {
+        std::cerr << "\nfirst arg can be either `part1`, `part2` or `tiled`\n";
         printHelp();
         return 1;
     }
+
+    if(task == "tiled") {
+        try {
+            const auto start = std::chrono::high_resolution_clock::now();
+            const MappedFile file{argv[2]};
+            const auto totals{tiled::solve(tiled::HeightMap{file.view()})};
+            const auto end = std::chrono::high_resolution_clock::now();
+
+            rusage usage{};
+            ::getrusage(RUSAGE_SELF, &usage);
+            std::cout << "part1: " << totals.score
+            << "\npart2: " << totals.rating
+            << "\nelapsed " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms"
+            << ", peak RSS " << usage.ru_maxrss << "KiB";
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "\nexception: " << ex.what();
+            return 1;
+        }
+        return 0;
+    }
     
     std::vector<std::string> inputVec;
     readInput(argv[2], std::back_inserter(inputVec));
 
-    if(task == "part1") {
-        std::cout << solveFirstPart(inputVec);
+    try {
+        if(task == "part1") {
+            std::cout << solveFirstPart(inputVec);
+        }
+        else {
+            std::cout << solveSecondPart(inputVec);
+        }
     }
-    else {
-        std::cout << solveSecondPart(inputVec);
+    catch(const std::exception& ex) {
+        std::cerr << "\nexception: " << ex.what();
+        return 1;
     }
 
     return 0;
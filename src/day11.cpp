@@ -1,46 +1,127 @@
 #include "common_headers.hpp"
 #include "utils/numeric_algorithm.hpp"
+#include "utils/parallel.hpp"
 
+#include <cctype>
 #include <cmath>
 #include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
 #include <sstream>
 
 
-using HashTable = std::unordered_map<size_t, std::unordered_map<size_t, uint64_t>>;
-size_t calculateStones(size_t maxBlinks, size_t blinks, uint64_t num, HashTable& cache) { 
+// The stones a stone turns into after one blink. Only a stone with an even number of digits turns into two.
+[[nodiscard]] std::pair<uint64_t, std::optional<uint64_t>> applyBlink(uint64_t num) {
+    if(num == 0) {
+        return {1, std::nullopt};
+    }
+    if(const auto countOfDigits{numOfDigits(num)}; countOfDigits % 2 == 0) {
+        const auto [num1, num2] = splitNum(num, countOfDigits);
+        return {num1, num2};
+    }
+    uint64_t product{};
+    if(__builtin_mul_overflow(num, uint64_t{2024}, &product)) {
+        throw std::overflow_error{"Stone value exceeds uint64_t"};
+    }
+    return {product, std::nullopt};
+}
 
-    if(cache[num].count(blinks)) {
-        return cache[num][blinks];
+// Open-addressing map from stone value to the number of stones with that value.
+// The order of stones never matters, so a blink only needs these counts. A zero count marks an empty slot.
+class StoneCounts final
+{
+public:
+    void add(uint64_t value, uint64_t count) {
+        if(2 * (m_size + 1) > m_slots.size()) {
+            grow();
+        }
+        Slot& slot{find(m_slots, value)};
+        if(slot.count == 0) {
+            slot.value = value;
+            ++m_size;
+        }
+        slot.count += count;
     }
-    if(blinks == maxBlinks) {
-        return 1;
+
+    // Empties the map but keeps its capacity for the next blink.
+    void clear() noexcept {
+        std::ranges::fill(m_slots, Slot{});
+        m_size = 0;
     }
-    if(num == 0) {
-        const auto stones = calculateStones(maxBlinks, blinks + 1, 1, cache);
-        cache[num][blinks] = stones ;
+
+    [[nodiscard]] size_t distinct() const noexcept {
+        return m_size;
     }
-    else if(auto countOfDigits = numOfDigits(num); countOfDigits % 2 == 0) {
-        const auto [num1, num2] = splitNum(num, countOfDigits);
-        
-        const auto stones1 = calculateStones(maxBlinks, blinks + 1, num1, cache);
-        const auto stones2 = calculateStones(maxBlinks, blinks + 1, num2, cache);
-        cache[num][blinks] = stones1 + stones2;
+
+    [[nodiscard]] uint64_t total() const noexcept {
+        return std::accumulate(m_slots.begin(), m_slots.end(), uint64_t{}, [](uint64_t sum, const Slot& slot) {
+            return sum + slot.count;
+        });
     }
-    else {
-        const auto stones = calculateStones(maxBlinks, blinks + 1, num * 2024, cache);
-        cache[num][blinks] = stones;
+
+    template<typename Visitor>
+    void forEach(Visitor&& visit) const {
+        for(const auto& slot : m_slots) {
+            if(slot.count != 0) {
+                visit(slot.value, slot.count);
+            }
+        }
     }
 
-    return cache[num][blinks];
+private:
+    struct Slot
+    {
+        uint64_t value{};
+        uint64_t count{};
+    };
+
+    [[nodiscard]] static Slot& find(std::vector<Slot>& slots, uint64_t value) noexcept {
+        const size_t mask{slots.size() - 1};
+        size_t index{static_cast<size_t>((value * 0x9E3779B97F4A7C15ull) >> 32) & mask};
+        while(slots[index].count != 0 && slots[index].value != value) {
+            index = (index + 1) & mask;
+        }
+        return slots[index];
+    }
+
+    void grow() {
+        std::vector<Slot> slots(std::max<size_t>(16, 2 * m_slots.size()));
+        for(const auto& slot : m_slots) {
+            if(slot.count != 0) {
+                find(slots, slot.value) = slot;
+            }
+        }
+        m_slots = std::move(slots);
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_size{};
+};
+
+// Applies one blink to every stone of `current`.
+void blink(const StoneCounts& current, StoneCounts& next) {
+    next.clear();
+    current.forEach([&](uint64_t num, uint64_t count) {
+        const auto [first, second] = applyBlink(num);
+        next.add(first, count);
+        if(second) {
+            next.add(*second, count);
+        }
+    });
 }
 
 size_t solveFirstPart(const std::vector<uint64_t>& stones, size_t maxBlinks) { 
-    HashTable cache;
-    size_t stoneCounter{};
-    for(auto it = stones.rbegin(); it != stones.rend(); ++it) {
-        stoneCounter += calculateStones(maxBlinks, 0, *it, cache);
+    StoneCounts current;
+    StoneCounts next;
+    for(const auto stone : stones) {
+        current.add(stone, 1);
+    }
+    for(size_t blinks = 0; blinks < maxBlinks; ++blinks) {
+        blink(current, next);
+        std::swap(current, next);
     }
-    return stoneCounter;
+    return current.total();
 }
 
 std::vector<uint64_t> lineParser(const std::string& line) {
@@ -54,15 +135,451 @@ std::vector<uint64_t> lineParser(const std::string& line) {
     return nums;
 }
 
+// Huge blink counts. The distinct values reachable from the seeds close into a graph of a few thousand nodes,
+// so it is discovered once and the counts are then advanced on the graph instead of on values.
+namespace fastforward {
+
+constexpr uint32_t gNoStone{std::numeric_limits<uint32_t>::max()};
+
+// Protects against seeds whose values never close into a finite graph.
+constexpr size_t gMaxGraphNodes{size_t{1} << 22};
+
+struct TransitionGraph
+{
+    std::vector<uint64_t> values;
+    // Nodes a stone turns into after one blink. The second one is gNoStone unless the stone splits.
+    std::vector<std::array<uint32_t, 2>> next;
+    std::vector<uint32_t> seeds;
+};
+
+[[nodiscard]] TransitionGraph discoverGraph(const std::vector<uint64_t>& stones) {
+    TransitionGraph graph;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    const auto nodeOf = [&](uint64_t value) {
+        const auto [it, inserted] = ids.try_emplace(value, static_cast<uint32_t>(graph.values.size()));
+        if(inserted) {
+            if(graph.values.size() == gMaxGraphNodes) {
+                throw std::runtime_error{"The stones do not close into a finite graph"};
+            }
+            graph.values.push_back(value);
+        }
+        return it->second;
+    };
+
+    for(const auto stone : stones) {
+        graph.seeds.push_back(nodeOf(stone));
+    }
+    // New nodes are appended, so walking the growing vector is a breadth-first search.
+    for(size_t node = 0; node < graph.values.size(); ++node) {
+        const auto [first, second] = applyBlink(graph.values[node]);
+        graph.next.push_back({nodeOf(first), second ? nodeOf(*second) : gNoStone});
+    }
+    return graph;
+}
+
+// One blink applied to the counts of every node. `add` defines the arithmetic of the counts.
+template<typename Count, typename Add>
+void blink(const TransitionGraph& graph, const std::vector<Count>& current, std::vector<Count>& next, const Add& add) {
+    std::ranges::fill(next, Count{});
+    for(size_t node = 0; node < current.size(); ++node) {
+        if(current[node] == Count{}) continue;
+        for(const auto target : graph.next[node]) {
+            if(target != gNoStone) {
+                next[target] = add(next[target], current[node]);
+            }
+        }
+    }
+}
+
+// Exact count, one blink at a time. The count grows exponentially, so this only makes sense
+// for as many blinks as fit into 128 bits. Throws std::overflow_error beyond that.
+[[nodiscard]] uint128_t countStones(const TransitionGraph& graph, uint64_t blinks) {
+    const auto checkedAdd = [](uint128_t a, uint128_t b) {
+        uint128_t sum{};
+        if(__builtin_add_overflow(a, b, &sum)) {
+            throw std::overflow_error{"Stone count exceeds 128 bits, use a modulus"};
+        }
+        return sum;
+    };
+
+    std::vector<uint128_t> current(graph.values.size());
+    std::vector<uint128_t> next(graph.values.size());
+    for(const auto seed : graph.seeds) {
+        ++current[seed];
+    }
+    for(uint64_t blink = 0; blink < blinks; ++blink) {
+        fastforward::blink(graph, current, next, checkedAdd);
+        std::swap(current, next);
+    }
+    return std::accumulate(current.begin(), current.end(), uint128_t{}, checkedAdd);
+}
+
+// Berlekamp-Massey over the prime field. Returns c with sequence[t] = sum c[i] * sequence[t - 1 - i].
+[[nodiscard]] std::vector<uint64_t> findRecurrence(const std::vector<uint64_t>& sequence, uint64_t modulus) {
+    std::vector<uint64_t> current{1};
+    std::vector<uint64_t> previous{1};
+    size_t length{};
+    size_t shift{1};
+    uint64_t previousDiscrepancy{1};
+
+    for(size_t n = 0; n < sequence.size(); ++n) {
+        uint64_t discrepancy{sequence[n]};
+        for(size_t i = 1; i <= length; ++i) {
+            discrepancy = (discrepancy + mulMod(current[i], sequence[n - i], modulus)) % modulus;
+        }
+        if(discrepancy == 0) {
+            ++shift;
+            continue;
+        }
+
+        const uint64_t coef{mulMod(discrepancy, powMod(previousDiscrepancy, modulus - 2, modulus), modulus)};
+        const auto updated = [&] {
+            std::vector<uint64_t> poly{current};
+            poly.resize(std::max(poly.size(), previous.size() + shift));
+            for(size_t i = 0; i < previous.size(); ++i) {
+                poly[i + shift] = (poly[i + shift] + modulus - mulMod(coef, previous[i], modulus)) % modulus;
+            }
+            return poly;
+        }();
+
+        if(2 * length <= n) {
+            previous = std::exchange(current, updated);
+            length = n + 1 - length;
+            previousDiscrepancy = discrepancy;
+            shift = 1;
+        }
+        else {
+            current = updated;
+            ++shift;
+        }
+    }
+
+    std::vector<uint64_t> recurrence(length);
+    for(size_t i = 0; i < length; ++i) {
+        recurrence[i] = i + 1 < current.size() ? (modulus - current[i + 1]) % modulus : 0;
+    }
+    return recurrence;
+}
+
+// a * b modulo the characteristic polynomial x^L - c[0] x^(L-1) - ... - c[L-1] of the recurrence.
+[[nodiscard]] std::vector<uint64_t> multiplyModulo(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b,
+    const std::vector<uint64_t>& recurrence, uint64_t modulus) {
+    const size_t length{recurrence.size()};
+    // Products are below 2^126, so a running sum only has to be reduced when it crosses 2^127.
+    constexpr uint128_t reduceAbove{uint128_t{1} << 127};
+    std::vector<uint128_t> product(2 * length - 1);
+    for(size_t i = 0; i < length; ++i) {
+        if(a[i] == 0) continue;
+        for(size_t j = 0; j < length; ++j) {
+            product[i + j] += uint128_t{a[i]} * b[j];
+            if(product[i + j] >= reduceAbove) {
+                product[i + j] %= modulus;
+            }
+        }
+    }
+    for(size_t degree = product.size(); degree-- > length;) {
+        const auto coef{static_cast<uint64_t>(product[degree] % modulus)};
+        for(size_t i = 0; i < length; ++i) {
+            auto& target = product[degree - 1 - i];
+            target += uint128_t{coef} * recurrence[i];
+            if(target >= reduceAbove) {
+                target %= modulus;
+            }
+        }
+    }
+
+    std::vector<uint64_t> result(length);
+    for(size_t i = 0; i < length; ++i) {
+        result[i] = static_cast<uint64_t>(product[i] % modulus);
+    }
+    return result;
+}
+
+// Count modulo a prime. The total after t blinks is a linear recurrence of order at most the number
+// of nodes, so 2 * nodes blinks on the graph are enough to recover it. The requested term is then
+// x^blinks modulo the characteristic polynomial, which needs only log(blinks) polynomial products.
+[[nodiscard]] uint64_t countStones(const TransitionGraph& graph, uint64_t blinks, uint64_t modulus) {
+    if(modulus >= (uint64_t{1} << 63) || !isPrime(modulus)) {
+        throw std::invalid_argument{"The modulus has to be a prime below 2^63"};
+    }
+
+    const auto addModulo = [modulus](uint64_t a, uint64_t b) {
+        const uint64_t sum{a + b};
+        return sum >= modulus ? sum - modulus : sum;
+    };
+    const auto total = [&](const std::vector<uint64_t>& counts) {
+        return std::accumulate(counts.begin(), counts.end(), uint64_t{}, addModulo);
+    };
+
+    std::vector<uint64_t> current(graph.values.size());
+    std::vector<uint64_t> next(graph.values.size());
+    for(const auto seed : graph.seeds) {
+        current[seed] = addModulo(current[seed], 1 % modulus);
+    }
+
+    const size_t terms{2 * graph.values.size() + 2};
+    std::vector<uint64_t> sequence{total(current)};
+    while(sequence.size() < terms && sequence.size() <= blinks) {
+        blink(graph, current, next, addModulo);
+        std::swap(current, next);
+        sequence.push_back(total(current));
+    }
+    if(blinks < sequence.size()) {
+        return sequence[blinks];
+    }
+
+    const auto recurrence{findRecurrence(sequence, modulus)};
+    const size_t length{recurrence.size()};
+    if(length == 0) {
+        return 0;
+    }
+
+    std::vector<uint64_t> result(length);
+    std::vector<uint64_t> power(length);
+    result[0] = 1 % modulus;
+    if(length > 1) {
+        power[1] = 1;
+    }
+    else {
+        power[0] = recurrence[0];
+    }
+    for(uint64_t exponent = blinks; exponent != 0; exponent >>= 1) {
+        if(exponent & 1) {
+            result = multiplyModulo(result, power, recurrence, modulus);
+        }
+        if(exponent > 1) {
+            power = multiplyModulo(power, power, recurrence, modulus);
+        }
+    }
+
+    uint64_t answer{};
+    for(size_t i = 0; i < length; ++i) {
+        answer = addModulo(answer, mulMod(result[i], sequence[i], modulus));
+    }
+    return answer;
+}
+
+} // namespace fastforward
+
+// Many seed stones on all cores. Seeds are counted one by one with a memo of (value, remaining blinks).
+// The memo does not depend on the total number of blinks, so a warm memo serves any later run.
+namespace sharded {
+
+struct MemoKey
+{
+    uint64_t value{};
+    uint32_t blinks{};
+
+    [[nodiscard]] bool operator==(const MemoKey&) const = default;
+};
+
+struct MemoKeyHash
+{
+    [[nodiscard]] size_t operator()(MemoKey key) const noexcept {
+        return static_cast<size_t>((key.value * 0x9E3779B97F4A7C15ull) ^ (uint64_t{key.blinks} * 0xC2B2AE3D27D4EB4Full));
+    }
+};
+
+using Count = uint128_t;
+using Memo = std::unordered_map<MemoKey, Count, MemoKeyHash>;
+
+// The recursion is as deep as the number of blinks. Counts exceed 128 bits long before this limit.
+constexpr uint32_t gMaxBlinks{1024};
+
+[[nodiscard]] Count checkedAdd(Count a, Count b) {
+    Count sum{};
+    if(__builtin_add_overflow(a, b, &sum)) {
+        throw std::overflow_error{"Stone count exceeds 128 bits, use fastforward with a modulus"};
+    }
+    return sum;
+}
+
+// Memo shared by all workers. Keys are spread over independently locked stripes,
+// so workers rarely wait for each other.
+class SharedMemo final
+{
+public:
+    [[nodiscard]] std::optional<Count> find(MemoKey key) const {
+        const Stripe& stripe{stripeOf(key)};
+        const std::lock_guard lock{stripe.mutex};
+        const auto it{stripe.memo.find(key)};
+        return it != stripe.memo.end() ? std::optional{it->second} : std::nullopt;
+    }
+
+    void insert(MemoKey key, Count count) {
+        Stripe& stripe{stripeOf(key)};
+        const std::lock_guard lock{stripe.mutex};
+        stripe.memo.emplace(key, count);
+    }
+
+    // Text format, one `value blinks count` entry per line.
+    void save(std::ostream& out) const {
+        for(const auto& stripe : m_stripes) {
+            const std::lock_guard lock{stripe.mutex};
+            for(const auto& [key, count] : stripe.memo) {
+                out << key.value << ' ' << key.blinks << ' ' << toString(count) << '\n';
+            }
+        }
+    }
+
+    void load(std::istream& in) {
+        MemoKey key;
+        std::string count;
+        while(in >> key.value >> key.blinks >> count) {
+            insert(key, parseCount(count));
+        }
+    }
+
+private:
+    struct Stripe
+    {
+        mutable std::mutex mutex;
+        Memo memo;
+    };
+
+    static constexpr size_t gStripes{64};
+
+    [[nodiscard]] static Count parseCount(std::string_view digits) {
+        Count count{};
+        for(const char digit : digits) {
+            if(!std::isdigit(static_cast<unsigned char>(digit)) || __builtin_mul_overflow(count, Count{10}, &count)) {
+                throw std::runtime_error{"Invalid count in the memo file"};
+            }
+            count = checkedAdd(count, static_cast<Count>(digit - '0'));
+        }
+        return count;
+    }
+
+    [[nodiscard]] Stripe& stripeOf(MemoKey key) noexcept {
+        return m_stripes[(MemoKeyHash{}(key) >> 32) % gStripes];
+    }
+
+    [[nodiscard]] const Stripe& stripeOf(MemoKey key) const noexcept {
+        return m_stripes[(MemoKeyHash{}(key) >> 32) % gStripes];
+    }
+
+    std::array<Stripe, gStripes> m_stripes;
+};
+
+// Shallow entries are cheaper to recompute than to share, so they stay in the worker's own memo.
+constexpr uint32_t gSharedMinBlinks{10};
+
+[[nodiscard]] Count countStones(uint64_t num, uint32_t blinks, Memo& local, SharedMemo& shared) {
+    if(blinks == 0) {
+        return 1;
+    }
+
+    const MemoKey key{num, blinks};
+    if(const auto it{local.find(key)}; it != local.end()) {
+        return it->second;
+    }
+    if(blinks >= gSharedMinBlinks) {
+        if(const auto count{shared.find(key)}) {
+            local.emplace(key, *count);
+            return *count;
+        }
+    }
+
+    const auto [first, second] = applyBlink(num);
+    Count stones{countStones(first, blinks - 1, local, shared)};
+    if(second) {
+        stones = checkedAdd(stones, countStones(*second, blinks - 1, local, shared));
+    }
+
+    local.emplace(key, stones);
+    if(blinks >= gSharedMinBlinks) {
+        shared.insert(key, stones);
+    }
+    return stones;
+}
+
+// Seeds are handed out one at a time, so expensive seeds do not leave other workers idle.
+// Only exact counts ever reach the memos: an overflow throws before anything wrapped is stored.
+[[nodiscard]] Count solve(const std::vector<uint64_t>& stones, uint32_t blinks, SharedMemo& shared) {
+    if(blinks > gMaxBlinks) {
+        throw std::invalid_argument{"At most " + std::to_string(gMaxBlinks) + " blinks, use fastforward for more"};
+    }
+
+    const size_t workers{std::max<size_t>(1, std::min(hardwareThreads(), stones.size()))};
+    std::vector<Memo> memos(workers);
+    std::vector<Count> counts(workers);
+    parallelFor(stones.size(), [&](size_t seed, size_t worker) {
+        counts[worker] = checkedAdd(counts[worker], countStones(stones[seed], blinks, memos[worker], shared));
+    }, workers);
+    return std::accumulate(counts.begin(), counts.end(), Count{}, checkedAdd);
+}
+
+} // namespace sharded
+
 void printHelp()
 {
     std::cerr << "\nUsage:\n"
     << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day7 part1 data/day7.txt";
+    << "\nFor example, ./day11 part1 data/day11.txt"
+    << "\nArbitrary blink counts: ./day11 fastforward <file> <blinks> [prime modulus]"
+    << "\nWithout a modulus the count is exact and has to fit into 128 bits."
+    << "\nMany seeds on all cores: ./day11 sharded <file> <blinks> [memo file]"
+    << "\nThe memo file is loaded if it exists and saved after the run, so it can warm up later runs.";
+}
+
+[[nodiscard]] uint64_t parseArgument(std::string_view arg) {
+    uint64_t value{};
+    const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    if(ec != std::errc{} || ptr != arg.data() + arg.size()) {
+        throw std::invalid_argument{"Not a number: " + std::string{arg}};
+    }
+    return value;
 }
 
 int main(int argc, char* argv[])
 {
+    if(argc >= 4 && argc <= 5 && std::string_view{argv[1]} == "fastforward") {
+        std::vector<std::vector<uint64_t>> inputVec;
+        readInput(argv[2], std::back_inserter(inputVec), lineParser);
+        try {
+            const auto graph{fastforward::discoverGraph(inputVec.at(0))};
+            const uint64_t blinks{parseArgument(argv[3])};
+            if(argc == 5) {
+                std::cout << fastforward::countStones(graph, blinks, parseArgument(argv[4]));
+            }
+            else {
+                std::cout << toString(fastforward::countStones(graph, blinks));
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "\nexception: " << ex.what();
+            return 1;
+        }
+        return 0;
+    }
+
+    if(argc >= 4 && argc <= 5 && std::string_view{argv[1]} == "sharded") {
+        std::vector<std::vector<uint64_t>> inputVec;
+        readInput(argv[2], std::back_inserter(inputVec), lineParser);
+        try {
+            const uint64_t blinks{parseArgument(argv[3])};
+            if(blinks > std::numeric_limits<uint32_t>::max()) {
+                throw std::invalid_argument{"Too many blinks"};
+            }
+
+            sharded::SharedMemo memo;
+            if(argc == 5 && std::filesystem::exists(argv[4])) {
+                std::ifstream memoFile(argv[4]);
+                memo.load(memoFile);
+            }
+            std::cout << toString(sharded::solve(inputVec.at(0), static_cast<uint32_t>(blinks), memo));
+            if(argc == 5) {
+                std::ofstream memoFile(argv[4]);
+                memo.save(memoFile);
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "\nexception: " << ex.what();
+            return 1;
+        }
+        return 0;
+    }
+
     if(argc != 3) {
         printHelp();
         return 1;
@@ -78,13 +595,19 @@ int main(int argc, char* argv[])
     std::vector<std::vector<uint64_t>> inputVec;
     readInput(argv[2], std::back_inserter(inputVec), lineParser);
 
-    if(task == "part1") {
-        const size_t maxBlinks{25};
-        std::cout << solveFirstPart(inputVec.at(0), maxBlinks);
+    try {
+        if(task == "part1") {
+            const size_t maxBlinks{25};
+            std::cout << solveFirstPart(inputVec.at(0), maxBlinks);
+        }
+        else {
+            const size_t maxBlinks{75};
+            std::cout << solveFirstPart(inputVec.at(0), maxBlinks);
+        }
     }
-    else {
-        const size_t maxBlinks{75};
-        std::cout << solveFirstPart(inputVec.at(0), maxBlinks);
+    catch(const std::exception& ex) {
+        std::cerr << "\nexception: " << ex.what();
+        return 1;
     }
 
     return 0;
@@ -1,149 +1,294 @@
 #include "common_headers.hpp"
+#include "utils/parallel.hpp"
+
 #include <array>
-#include <set>
-#include <stack>
+#include <bit>
+#include <limits>
 
-constexpr std::array<int,5> offsets{0, 1, 0, -1, 0};
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-using CoordinateMap = std::set<std::pair<int, int>>;
+// Copy of the map surrounded by a frame of sentinel cells, so every cell has eight neighbours.
+class PaddedMap final
+{
+public:
+    static constexpr char gSentinel{'\0'};
 
-[[nodiscard]] size_t calculatePerimeter(const std::vector<std::string>& map, int row, int col) {
-    size_t perimeter{};
-    for(int i = 0; i < 4; ++i) {
-        const int newRow{row + offsets[i]};
-        const int newCol{col + offsets[i + 1]};
-        if(newRow < 0 || newCol < 0 || newRow >= map.size() || newCol >= map[0].size()) {
-            ++perimeter;
-        }
-        else {
-            perimeter += map[row][col] != map[newRow][newCol];
+    explicit PaddedMap(const std::vector<std::string>& map)
+    : m_rows{map.size()}
+    , m_cols{map[0].size()}
+    , m_cells((m_rows + 2) * (m_cols + 2), gSentinel)
+    {
+        for(size_t row = 0; row < m_rows; ++row) {
+            if(map[row].size() != m_cols) {
+                throw std::logic_error{"Rows of the map differ in length"};
+            }
+            std::ranges::copy(map[row], m_cells.begin() + static_cast<ptrdiff_t>((row + 1) * stride() + 1));
         }
     }
-    return perimeter;
-}
 
-[[nodiscard]] size_t calculateCorner(const std::vector<std::string>& map, int row, int col) {
-    size_t counter{};
-    const char plot{map[row][col]};
-    // top left outer
-    if((row - 1 < 0 || plot != map[row - 1][col]) && (col - 1 < 0 || map[row][col - 1] != plot)) {
-        ++counter;
+    [[nodiscard]] size_t rows() const noexcept {
+        return m_rows;
     }
-    // top right outer
-    if((row - 1 < 0 || plot != map[row - 1][col]) && (col + 1 >= map[0].size() || map[row][col + 1] != plot)) {
-        ++counter;
+
+    [[nodiscard]] size_t cols() const noexcept {
+        return m_cols;
     }
-    // bottom left
-    if((row + 1 >= map.size() || map[row + 1][col] != plot) && (col - 1 < 0 || map[row][col - 1] != plot)) {
-        ++counter;
+
+    [[nodiscard]] size_t stride() const noexcept {
+        return m_cols + 2;
     }
-    // bottom right
-    if((row + 1 >= map.size() || map[row + 1][col] != plot) && (col + 1 >= map[0].size() || map[row][col + 1] != plot)) {
-        ++counter;
+
+    // Pointer to the first cell of a row of the original map.
+    [[nodiscard]] const char* row(size_t row) const noexcept {
+        return m_cells.data() + (row + 1) * stride() + 1;
     }
 
-    // top left inner
-    if(row - 1 >= 0 && map[row - 1][col] == plot && col - 1 >= 0 && map[row][col - 1] == plot && map[row - 1][col - 1] != plot) {
-        ++counter;
+private:
+    size_t m_rows{};
+    size_t m_cols{};
+    std::vector<char> m_cells;
+};
+
+// Bit k of a neighbourhood mask is set if the neighbour in direction k holds the same plot.
+// Orthogonal neighbours come first, then the diagonal that lies between direction k and k + 1.
+enum Neighbour : uint8_t { North, East, South, West, NorthEast, SouthEast, SouthWest, NorthWest };
+
+[[nodiscard]] constexpr std::array<ptrdiff_t, 8> neighbourOffsets(size_t stride) noexcept {
+    const auto line{static_cast<ptrdiff_t>(stride)};
+    return {-line, 1, line, -1, 1 - line, 1 + line, line - 1, -line - 1};
+}
+
+struct CellStats
+{
+    uint8_t perimeter{};
+    uint8_t corners{};
+};
+
+// Perimeter and corner contribution of a cell for every neighbourhood mask.
+// Between two orthogonal directions there is an outer corner if both neighbours differ,
+// and an inner corner if both match but the diagonal between them does not.
+constexpr auto gCellStats = [] {
+    std::array<CellStats, 256> table{};
+    for(size_t mask = 0; mask < table.size(); ++mask) {
+        const auto same = [&](size_t direction) { return (mask >> direction & 1) != 0; };
+        table[mask].perimeter = static_cast<uint8_t>(4 - std::popcount(mask & 0xF));
+        for(size_t direction = North; direction <= West; ++direction) {
+            const bool first{same(direction)};
+            const bool second{same((direction + 1) % 4)};
+            const bool diagonal{same(NorthEast + direction)};
+            table[mask].corners += (!first && !second) || (first && second && !diagonal);
+        }
     }
+    return table;
+}();
 
-    // top right inner
-    if(row - 1 >= 0 && map[row - 1][col] == plot && col + 1 < map[0].size() && map[row][col + 1] == plot && map[row - 1][col + 1] != plot) {
-        ++counter;
+static_assert(gCellStats[0].perimeter == 4 && gCellStats[0].corners == 4);
+static_assert(gCellStats[255].perimeter == 0 && gCellStats[255].corners == 0);
+static_assert(gCellStats[(1 << North) | (1 << East)].corners == 2);
+
+[[nodiscard]] inline uint8_t neighbourMask(const char* cell, const std::array<ptrdiff_t, 8>& offsets) noexcept {
+    uint8_t mask{};
+    for(size_t direction = 0; direction < offsets.size(); ++direction) {
+        mask |= static_cast<uint8_t>((cell[offsets[direction]] == *cell) << direction);
     }
+    return mask;
+}
+
+namespace simd {
+
+// Neighbourhood masks of gLanes consecutive cells: every direction is one compare of shifted rows,
+// AND-ed with the weight of its bit.
+#if defined(__AVX2__)
+constexpr size_t gLanes{32};
 
-    // bottom left inner
-    if(row + 1 < map.size() && map[row + 1][col] == plot && col - 1 >= 0 && map[row][col - 1] == plot && map[row + 1][col - 1] != plot) {
-        ++counter;
+inline void neighbourMasks(const char* cells, const std::array<ptrdiff_t, 8>& offsets, uint8_t* masks) noexcept {
+    const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells));
+    __m256i result = _mm256_setzero_si256();
+    for(size_t direction = 0; direction < offsets.size(); ++direction) {
+        const __m256i neighbour = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + offsets[direction]));
+        const __m256i weight = _mm256_set1_epi8(static_cast<char>(1u << direction));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi8(center, neighbour), weight));
     }
-    // bottom right inner
-    if(row + 1 < map.size() && map[row + 1][col] == plot && col + 1 < map[0].size() && map[row][col + 1] == plot && map[row + 1][col + 1] != plot) {
-        ++counter;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(masks), result);
+}
+#elif defined(__SSE2__)
+constexpr size_t gLanes{16};
+
+inline void neighbourMasks(const char* cells, const std::array<ptrdiff_t, 8>& offsets, uint8_t* masks) noexcept {
+    const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells));
+    __m128i result = _mm_setzero_si128();
+    for(size_t direction = 0; direction < offsets.size(); ++direction) {
+        const __m128i neighbour = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + offsets[direction]));
+        const __m128i weight = _mm_set1_epi8(static_cast<char>(1u << direction));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi8(center, neighbour), weight));
     }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(masks), result);
+}
+#else
+constexpr size_t gLanes{1};
 
-    return counter;
+inline void neighbourMasks(const char* cells, const std::array<ptrdiff_t, 8>& offsets, uint8_t* masks) noexcept {
+    *masks = neighbourMask(cells, offsets);
 }
+#endif
 
+} // namespace simd
 
-template<typename Handler>
-void traverse(const std::vector<std::string>& map, int row, int col, CoordinateMap& visited, Handler& handler) {
-    
-    const char plot{map[row][col]};
+// Masks of every cell of a row. Loads of a full block stay inside the row and its sentinel frame.
+void rowMasks(const PaddedMap& map, size_t row, std::vector<uint8_t>& masks) noexcept {
+    const char* cells{map.row(row)};
+    const auto offsets{neighbourOffsets(map.stride())};
+    size_t col{};
+    for(; col + simd::gLanes <= map.cols(); col += simd::gLanes) {
+        simd::neighbourMasks(cells + col, offsets, masks.data() + col);
+    }
+    for(; col < map.cols(); ++col) {
+        masks[col] = neighbourMask(cells + col, offsets);
+    }
+}
+
+struct RegionStats
+{
+    size_t area{};
+    size_t perimeter{};
+    size_t corners{};
+};
+
+// Union-find over the cells of the map. Every root carries the stats of its whole region,
+// so merging two regions only has to add their stats.
+class Regions final
+{
+public:
+    explicit Regions(size_t cells) : m_parent(cells), m_stats(cells) {
+        for(uint32_t cell = 0; cell < cells; ++cell) {
+            m_parent[cell] = cell;
+        }
+    }
 
-    std::stack<std::pair<int, int>> dfs;
-    dfs.emplace(row, col);
+    [[nodiscard]] uint32_t find(uint32_t cell) noexcept {
+        while(m_parent[cell] != cell) {
+            m_parent[cell] = m_parent[m_parent[cell]];
+            cell = m_parent[cell];
+        }
+        return cell;
+    }
 
-    while(!dfs.empty()) {
-        const auto [r, c] = dfs.top();
-        dfs.pop();
-        if(visited.emplace(std::pair{r, c}).second == false) continue;
+    void unite(uint32_t cellA, uint32_t cellB) noexcept {
+        uint32_t rootA{find(cellA)};
+        uint32_t rootB{find(cellB)};
+        if(rootA == rootB) return;
+        if(m_stats[rootA].area < m_stats[rootB].area) {
+            std::swap(rootA, rootB);
+        }
+        m_parent[rootB] = rootA;
+        m_stats[rootA].area += m_stats[rootB].area;
+        m_stats[rootA].perimeter += m_stats[rootB].perimeter;
+        m_stats[rootA].corners += m_stats[rootB].corners;
+    }
+
+    [[nodiscard]] RegionStats& stats(uint32_t cell) noexcept {
+        return m_stats[cell];
+    }
 
-        handler(map, r, c);
+    [[nodiscard]] bool isRoot(uint32_t cell) const noexcept {
+        return m_parent[cell] == cell;
+    }
 
-        for(int i = 0; i < 4; ++i) {
-            const int newRow{r + offsets[i]};
-            const int newCol{c + offsets[i + 1]};
-            if(newRow < 0 || newCol < 0 || newRow >= map.size() || newCol >= map[0].size()) {
-                continue;
+private:
+    std::vector<uint32_t> m_parent;
+    std::vector<RegionStats> m_stats;
+};
+
+struct Prices
+{
+    size_t perimeter{};
+    size_t sides{};
+};
+
+// Labels the rows [firstRow, lastRow) row by row. Perimeter and corners only depend on the neighbourhood mask
+// of a cell, so each cell starts as its own region and is merged with the same plots above and to the left.
+// Merges never reach the row above the band, so bands touch disjoint cells and can be labelled concurrently.
+void labelBand(const PaddedMap& padded, Regions& regions, size_t firstRow, size_t lastRow) {
+    const size_t cols{padded.cols()};
+    std::vector<uint8_t> masks(cols);
+    for(size_t row = firstRow; row < lastRow; ++row) {
+        rowMasks(padded, row, masks);
+        for(size_t col = 0; col < cols; ++col) {
+            const auto cell{static_cast<uint32_t>(row * cols + col)};
+            const uint8_t mask{masks[col]};
+            regions.stats(cell) = RegionStats{1, gCellStats[mask].perimeter, gCellStats[mask].corners};
+            if(row > firstRow && (mask & (1 << North))) {
+                regions.unite(cell, static_cast<uint32_t>(cell - cols));
             }
-            else if(plot == map[newRow][newCol]) {
-                dfs.emplace(newRow, newCol);
+            if(mask & (1 << West)) {
+                regions.unite(cell, cell - 1);
             }
         }
     }
 }
 
-[[nodiscard]] size_t solveFirstPart(const std::vector<std::string>& map) {
-    size_t totalPrice{};
-    CoordinateMap visited;
-    
+// The map is cut into horizontal bands that are labelled in parallel. The stats of a cell are taken
+// from the full padded map, so they are exact at the seams too, and joining the regions across
+// each seam is all that is left to do. The number of sides of a region equals the number of its corners.
+[[nodiscard]] Prices calculatePrices(const std::vector<std::string>& map) {
+    const PaddedMap padded{map};
+    const size_t rows{padded.rows()};
+    const size_t cols{padded.cols()};
+    if(rows * cols > std::numeric_limits<uint32_t>::max()) {
+        throw std::logic_error{"The map is too large"};
+    }
 
-    for(int row = 0; row < map.size(); ++row) {
-        for(int col = 0; col < map[0].size(); ++col) {
-            if(visited.count(std::pair(row, col))) continue;
+    // A few bands per worker let the shared counter balance them.
+    const size_t bands{std::min(rows, 4 * hardwareThreads())};
+    const auto bandStart = [&](size_t band) { return band * rows / bands; };
 
-            size_t area{};
-            size_t perimeter{};
-            auto calculator = [&](const std::vector<std::string>& map, int row, int col) mutable {
-                ++area;
-                perimeter += calculatePerimeter(map, row, col);
-            };
+    Regions regions{rows * cols};
+    parallelFor(bands, [&](size_t band, size_t) {
+        labelBand(padded, regions, bandStart(band), bandStart(band + 1));
+    });
 
-            traverse(map, row, col, visited, calculator);
-            totalPrice += area * perimeter;
+    for(size_t band = 1; band < bands; ++band) {
+        const size_t row{bandStart(band)};
+        const char* cells{padded.row(row)};
+        const char* above{padded.row(row - 1)};
+        for(size_t col = 0; col < cols; ++col) {
+            if(cells[col] == above[col]) {
+                regions.unite(static_cast<uint32_t>(row * cols + col), static_cast<uint32_t>((row - 1) * cols + col));
+            }
         }
     }
-    return totalPrice;
-}
 
-[[nodiscard]] size_t solveSecondPart(const std::vector<std::string>& map) {
-    size_t totalPrice{};
-    CoordinateMap visited;
-
-    for(int row = 0; row < map.size(); ++row) {
-        for(int col = 0; col < map[0].size(); ++col) {
-            if(visited.count(std::pair(row, col))) continue;
-
-            size_t area{};
-            size_t perimeter{};
-            auto calculator = [&](const std::vector<std::string>& map, int row, int col) mutable {
-                ++area;
-                perimeter += calculateCorner(map, row, col);
-            };
-            traverse(map, row, col, visited, calculator);
-            totalPrice += area * perimeter;
+    std::vector<Prices> bandPrices(bands);
+    parallelFor(bands, [&](size_t band, size_t) {
+        for(auto cell = static_cast<uint32_t>(bandStart(band) * cols); cell < bandStart(band + 1) * cols; ++cell) {
+            if(!regions.isRoot(cell)) continue;
+            const RegionStats& region{regions.stats(cell)};
+            bandPrices[band].perimeter += region.area * region.perimeter;
+            bandPrices[band].sides += region.area * region.corners;
         }
-    }
+    });
+
+    return std::accumulate(bandPrices.begin(), bandPrices.end(), Prices{}, [](Prices sum, const Prices& band) {
+        return Prices{sum.perimeter + band.perimeter, sum.sides + band.sides};
+    });
+}
+
+[[nodiscard]] size_t solveFirstPart(const std::vector<std::string>& map) {
+    return calculatePrices(map).perimeter;
+}
 
-    return totalPrice;
+[[nodiscard]] size_t solveSecondPart(const std::vector<std::string>& map) {
+    return calculatePrices(map).sides;
 }
 
 
 void printHelp()
 {
     std::cerr << "\nUsage:\n"
-    << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day7 part1 data/day7.txt";
+    << "The program requires 2 args: (part1, part2, both) and the path to the file."
+    << "\nFor example, ./day12 part1 data/day12.txt";
 }
 
 int main(int argc, char* argv[])
@@ -154,20 +299,34 @@ int main(int argc, char* argv[])
     }
 
     std::string_view task{argv[1]};
-    if(task != "part1" && task != "part2") {
-        std::cerr << "\nfirst arg can be either `part1` or `part2`\n";
+    if(task != "part1" && task != "part2" && task != "both") {
+        std::cerr << "\nfirst arg can be either `part1`, `part2` or `both`\n";
         printHelp();
         return 1;
     }
     
     std::vector<std::string> inputVec;
     readInput(argv[2], std::back_inserter(inputVec));
+    if(inputVec.empty() || inputVec[0].empty()) {
+        std::cerr << "\nThe map is empty";
+        return 1;
+    }
 
-    if(task == "part1") {
-        std::cout << solveFirstPart(inputVec);
+    try {
+        if(task == "part1") {
+            std::cout << solveFirstPart(inputVec);
+        }
+        else if(task == "part2") {
+            std::cout << solveSecondPart(inputVec);
+        }
+        else {
+            const Prices prices{calculatePrices(inputVec)};
+            std::cout << prices.perimeter << "\n" << prices.sides;
+        }
     }
-    else {
-        std::cout << solveSecondPart(inputVec);
+    catch(const std::exception& ex) {
+        std::cerr << "\nexception: " << ex.what();
+        return 1;
     }
 
     return 0;
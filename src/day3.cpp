@@ -1,5 +1,12 @@
 #include "common_headers.hpp"
-#include <regex>
+#include "utils/mapped_file.hpp"
+#include "utils/parallel.hpp"
+
+#include <optional>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*
 Part 1.
@@ -11,73 +18,244 @@ Part 2.
 More instructions are introduced: do() and don't(). The do() instruction enables multiplication.
 The don't() disables it.
 
-The task becomes simpler when using regex.
+The input is scanned once by a table-driven DFA. None of the instructions contains `m` or `d`
+after its first character, so a failed partial match can always be restarted at the current byte
+and the scanner never has to step back.
+
+The file is split into chunks that are scanned in parallel. A chunk owns every instruction that
+starts inside it, so an instruction straddling the chunk end is finished by reading past it.
+Since the enabled state is unknown at the start of a chunk, each chunk reports its sums for both
+cases, and a prefix pass over the chunks picks the right one.
 */
 
-int64_t doMul(const std::string& firstValStr, const std::string& secValStr) {
-    int firstVal{};
-    if(std::from_chars(&firstValStr[0], &firstValStr[firstValStr.size()], firstVal).ec != std::errc()) {
-        throw std::logic_error{"Failed to parse the first value"};
+enum class Instruction : uint8_t {Mul, Do, Dont};
+
+namespace scanner {
+
+enum CharClass : uint8_t {Other, M, U, L, LParen, RParen, Comma, D, O, N, Quote, T, Digit, ClassCount};
+
+enum State : uint8_t {
+    Start,
+    Mu, Mul, MulParen,
+    FirstArg1, FirstArg2, FirstArg3, Comma1,
+    SecondArg1, SecondArg2, SecondArg3,
+    Do, DoParen, Don, DonQuote, DonT, DonTParen,
+    // Accepting states. The scanner reports an instruction and continues from Start.
+    AcceptMul, AcceptDo, AcceptDont,
+    // `m` and `d` are the only bytes a match may start with.
+    FoundM, FoundD,
+    StateCount
+};
+
+constexpr std::array<CharClass, 256> gCharClasses = [] {
+    std::array<CharClass, 256> classes{};
+    classes['m'] = M;
+    classes['u'] = U;
+    classes['l'] = L;
+    classes['('] = LParen;
+    classes[')'] = RParen;
+    classes[','] = Comma;
+    classes['d'] = D;
+    classes['o'] = O;
+    classes['n'] = N;
+    classes['\''] = Quote;
+    classes['t'] = T;
+    for(char ch = '0'; ch <= '9'; ++ch) {
+        classes[static_cast<unsigned char>(ch)] = Digit;
     }
+    return classes;
+}();
+
+using TransitionTable = std::array<std::array<State, ClassCount>, StateCount>;
 
-    int secVal{};
-    if(std::from_chars(&secValStr[0], &secValStr[secValStr.size()], secVal).ec != std::errc()) {
-        throw std::logic_error{"Failed to parse the second value"};
+constexpr TransitionTable gTransitions = [] {
+    TransitionTable table{};
+    // Any unexpected byte drops to Start, except `m` and `d` which begin a new match.
+    for(auto& row : table) {
+        row.fill(Start);
+        row[M] = FoundM;
+        row[D] = FoundD;
     }
+    table[FoundM][U] = Mu;
+    table[Mu][L] = Mul;
+    table[Mul][LParen] = MulParen;
+    table[MulParen][Digit] = FirstArg1;
+    table[FirstArg1][Digit] = FirstArg2;
+    table[FirstArg2][Digit] = FirstArg3;
+    table[FirstArg1][Comma] = Comma1;
+    table[FirstArg2][Comma] = Comma1;
+    table[FirstArg3][Comma] = Comma1;
+    table[Comma1][Digit] = SecondArg1;
+    table[SecondArg1][Digit] = SecondArg2;
+    table[SecondArg2][Digit] = SecondArg3;
+    table[SecondArg1][RParen] = AcceptMul;
+    table[SecondArg2][RParen] = AcceptMul;
+    table[SecondArg3][RParen] = AcceptMul;
 
-    return firstVal * secVal;
+    table[FoundD][O] = Do;
+    table[Do][LParen] = DoParen;
+    table[DoParen][RParen] = AcceptDo;
+    table[Do][N] = Don;
+    table[Don][Quote] = DonQuote;
+    table[DonQuote][T] = DonT;
+    table[DonT][LParen] = DonTParen;
+    table[DonTParen][RParen] = AcceptDont;
+    return table;
+}();
+
+// Returns a pointer to the first `m` or `d` in [first, last), or `last` if there is none.
+[[nodiscard]] inline const char* findCandidate(const char* first, const char* last) noexcept
+{
+#if defined(__SSE2__)
+    const __m128i mChars = _mm_set1_epi8('m');
+    const __m128i dChars = _mm_set1_epi8('d');
+    for(; first + 16 <= last; first += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        const __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, mChars), _mm_cmpeq_epi8(block, dChars));
+        const int mask = _mm_movemask_epi8(hits);
+        if(mask != 0) {
+            return first + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    while(first != last && *first != 'm' && *first != 'd') {
+        ++first;
+    }
+    return first;
 }
 
-class PartTwo
+} // namespace scanner
+
+// Calls `handler(instruction, product)` for every well-formed instruction starting in [first, last).
+// The product is only meaningful for Instruction::Mul.
+template<typename Handler>
+void scanInstructions(std::string_view input, size_t first, size_t last, Handler&& handler)
 {
-public:
-    int64_t sovle(const std::string& input) {
-        int64_t result{};
-        
-        const std::regex regexPattern(R"(mul\(([0-9]{1,3}),([0-9]{1,3})\)|do\(\)|don\'t\(\))");
-        auto matchesBegin = std::sregex_iterator(input.begin(), input.end(), regexPattern);
-        auto matchesEnd = std::sregex_iterator();
-
-        for (auto it = matchesBegin; it != matchesEnd; ++it) {
-            std::smatch match = *it;
-            const std::string cmd{match[0]};
-            if(cmd == "do()") {
-                mulEnabled = true;
-            }
-            else if(cmd == "don't()") {
-                mulEnabled = false;
-            }
-            else if(mulEnabled) {                
-                std::string firstValStr{match.str(1)};
-                std::string secValStr{match.str(2)};
-                result += doMul(firstValStr, secValStr);
-            }
+    using namespace scanner;
+
+    const char* it = input.data() + first;
+    const char* const limit = input.data() + last;
+    const char* const end = input.data() + input.size();
+    State state{Start};
+    int64_t firstArg{};
+    int64_t secondArg{};
+
+    while(it != end) {
+        if(state == Start) {
+            if(it >= limit) break;
+            it = findCandidate(it, limit);
+            if(it == limit) break;
+        }
+
+        const char ch{*it++};
+        state = gTransitions[state][gCharClasses[static_cast<unsigned char>(ch)]];
+        switch(state) {
+        case FoundM:
+        case FoundD:
+            // Instructions starting past the chunk belong to the next one.
+            if(it > limit) return;
+            break;
+        case FirstArg1:
+            firstArg = ch - '0';
+            break;
+        case FirstArg2:
+        case FirstArg3:
+            firstArg = firstArg * 10 + (ch - '0');
+            break;
+        case SecondArg1:
+            secondArg = ch - '0';
+            break;
+        case SecondArg2:
+        case SecondArg3:
+            secondArg = secondArg * 10 + (ch - '0');
+            break;
+        case AcceptMul:
+            handler(Instruction::Mul, firstArg * secondArg);
+            state = Start;
+            break;
+        case AcceptDo:
+            handler(Instruction::Do, int64_t{});
+            state = Start;
+            break;
+        case AcceptDont:
+            handler(Instruction::Dont, int64_t{});
+            state = Start;
+            break;
+        default:
+            break;
         }
-        return result;
     }
-private:
-    bool mulEnabled{true};
+}
+
+struct ChunkSummary final
+{
+    // Sum of all products regardless of do()/don't().
+    int64_t total{};
+    // Products before the first do()/don't(). They count only if the chunk starts enabled.
+    int64_t leading{};
+    // Enabled products after the first do()/don't(). They do not depend on the chunk start.
+    int64_t trailing{};
+    // The last do()/don't() in the chunk.
+    std::optional<Instruction> lastToggle;
 };
 
-class PartOne
+[[nodiscard]] ChunkSummary summarizeChunk(std::string_view input, size_t first, size_t last)
+{
+    ChunkSummary summary;
+    bool mulEnabled{};
+    scanInstructions(input, first, last, [&](Instruction instruction, int64_t product) {
+        if(instruction != Instruction::Mul) {
+            summary.lastToggle = instruction;
+            mulEnabled = instruction == Instruction::Do;
+            return;
+        }
+
+        summary.total += product;
+        if(!summary.lastToggle) {
+            summary.leading += product;
+        }
+        else if(mulEnabled) {
+            summary.trailing += product;
+        }
+    });
+    return summary;
+}
+
+[[nodiscard]] std::vector<ChunkSummary> summarizeChunks(std::string_view input)
+{
+    constexpr size_t minChunkSize{1 << 20};
+    const size_t workers{hardwareThreads()};
+    const size_t chunks{std::clamp<size_t>(input.size() / minChunkSize, 1, workers * 4)};
+    const size_t chunkSize{(input.size() + chunks - 1) / chunks};
+
+    std::vector<ChunkSummary> summaries(chunks);
+    parallelFor(chunks, [&](size_t chunk, size_t) {
+        const size_t first{std::min(chunk * chunkSize, input.size())};
+        const size_t last{std::min(first + chunkSize, input.size())};
+        summaries[chunk] = summarizeChunk(input, first, last);
+    }, workers);
+    return summaries;
+}
+
+[[nodiscard]] int64_t solveFirstPart(const std::vector<ChunkSummary>& summaries) noexcept
+{
+    return std::accumulate(summaries.begin(), summaries.end(), int64_t{}, [](int64_t value, const ChunkSummary& summary) {
+        return value + summary.total;
+    });
+}
+
+[[nodiscard]] int64_t solveSecondPart(const std::vector<ChunkSummary>& summaries) noexcept
 {
-public:
-    [[nodiscard]] int64_t solve(const std::string& input) {
-        int64_t result{};
-        
-        const std::regex regexPattern(R"(mul\(([0-9]{1,3}),([0-9]{1,3})\))");
-        auto matchesBegin = std::sregex_iterator(input.begin(), input.end(), regexPattern);
-        auto matchesEnd = std::sregex_iterator();
-
-        for (auto it = matchesBegin; it != matchesEnd; ++it) {
-            std::smatch match = *it;
-            std::string firstValStr{match.str(1)};
-            std::string secValStr{match.str(2)};
-            result += doMul(firstValStr, secValStr);
+    int64_t result{};
+    bool mulEnabled{true};
+    for(const auto& summary : summaries) {
+        result += summary.trailing + (mulEnabled ? summary.leading : 0);
+        if(summary.lastToggle) {
+            mulEnabled = *summary.lastToggle == Instruction::Do;
         }
-        return result;
     }
-};
+    return result;
+}
 
 void printHelp()
 {
@@ -97,30 +275,19 @@ int main(int argc, char *argv[]) {
         printHelp();
         return 1;
     }
-    std::ifstream ifile(argv[2]);
-    if(!ifile) {
-        std::cerr << "\nFile cannot be open";
-        return 1;
-    }
-    PartOne part1;
-    PartTwo part2;
-    
     try {
-        int64_t result{};
-        std::string line;
-        while((ifile >> line)) {
-            if(task == "part1") {
-                result += part1.solve(line);
-            }
-            else {
-                result += part2.sovle(line);
-            }
+        const MappedFile file{argv[2]};
+        const auto summaries{summarizeChunks(file.view())};
+        if(task == "part1") {
+            std::cout << solveFirstPart(summaries);
+        }
+        else {
+            std::cout << solveSecondPart(summaries);
         }
-        std::cout << result;
     }
     catch(const std::exception& ex) {
         std::cerr << "\nexception: " << ex.what();
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,6 +1,14 @@
 #include "common_headers.hpp"
+#include "utils/mapped_file.hpp"
 
 #include <array>
+#include <bit>
+#include <limits>
+#include <queue>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 /*
@@ -11,149 +19,422 @@ More over, it can be written backwards.
 Part 2.
 The task is to count two MASin the shape of an X. Each MAS can be written forwards or backwards.
 
+Words mode.
+Counts every word of a dictionary in all eight directions of the grid. An Aho-Corasick automaton
+over the dictionary is fed each row, column and diagonal once per reading direction, so the cost
+does not depend on the number of words. A word is counted once per direction it can be read in,
+as `XMAS` is in part 1.
+
+Both parts keep a small window of the most recent rows and compare a whole block of columns
+at once: every letter of a word gives a bit mask of matching columns, the masks are ANDed
+together and the set bits are counted.
 */
 
+namespace simd {
+
+using Mask = uint32_t;
+
+#if defined(__AVX2__)
+constexpr size_t gLanes{32};
+
+[[nodiscard]] inline Mask equal(const char* data, char ch) noexcept {
+    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    return static_cast<Mask>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(ch))));
+}
+#elif defined(__SSE2__)
+constexpr size_t gLanes{16};
+
+[[nodiscard]] inline Mask equal(const char* data, char ch) noexcept {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    return static_cast<Mask>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(ch))));
+}
+#else
+constexpr size_t gLanes{1};
 
+[[nodiscard]] inline Mask equal(const char* data, char ch) noexcept {
+    return *data == ch;
+}
+#endif
+
+// Bit i is set if data[k][i] == word[k] for every k.
+template<size_t N>
+[[nodiscard]] inline Mask match(const std::array<const char*, N>& data, const std::array<char, N>& word) noexcept {
+    Mask mask{equal(data[0], word[0])};
+    for(size_t k = 1; k < N && mask != 0; ++k) {
+        mask &= equal(data[k], word[k]);
+    }
+    return mask;
+}
+
+} // namespace simd
+
+// Sliding window over the last N rows of the input.
+// Rows are views into the input buffer, so advancing the window only moves the ring head.
+template<size_t N>
 struct RowsReader final
 {
-    RowsReader(std::ifstream& ifile, size_t numOfRows) : m_ifile{ifile}, m_numOfRows{numOfRows} {
-        m_rows.reserve(numOfRows);
-    }
+    explicit RowsReader(std::string_view input) : m_input{input} {}
 
     [[nodiscard]] bool readNextLine() {
-        auto& rowToBeRead = getNextRow();
-        m_ifile >> rowToBeRead;
-        if(m_ifile) return true;
+        while(!m_input.empty()) {
+            const size_t end{std::min(m_input.find('\n'), m_input.size())};
+            std::string_view row{m_input.substr(0, end)};
+            m_input.remove_prefix(std::min(end + 1, m_input.size()));
+            if(!row.empty() && row.back() == '\r') {
+                row.remove_suffix(1);
+            }
+            if(row.empty()) continue;
+
+            if(m_count > 0 && row.size() != width()) {
+                throw std::logic_error{"All rows must have the same length"};
+            }
+            m_rows[m_head] = row;
+            m_head = (m_head + 1) % N;
+            m_count = std::min(m_count + 1, N);
+            return true;
+        }
         return false;
     }
 
-    [[nodiscard]] const std::vector<std::string>& getRows() const {
-        return m_rows;
+    [[nodiscard]] bool full() const noexcept {
+        return m_count == N;
     }
 
-private:
-    std::string& getNextRow() {
-        if(m_rows.size() < m_numOfRows) {
-            m_rows.emplace_back();
-        }
-        else {
-            std::move_backward(m_rows.rbegin(), std::next(m_rows.rbegin(), m_numOfRows - 1), m_rows.rend());
-        }
-        return m_rows.back();
+    // Returns rows from the oldest (0) to the newest (N - 1) once the window is full.
+    [[nodiscard]] const char* operator[](size_t id) const noexcept {
+        return m_rows[(m_head + id) % N].data();
+    }
+
+    [[nodiscard]] const char* newest() const noexcept {
+        return m_rows[(m_head + N - 1) % N].data();
+    }
+
+    [[nodiscard]] size_t width() const noexcept {
+        return m_rows[(m_head + N - 1) % N].size();
     }
 
 private:
-    std::ifstream& m_ifile;
-    size_t m_numOfRows{};
-    std::vector<std::string> m_rows;
+    std::string_view m_input;
+    std::array<std::string_view, N> m_rows{};
+    size_t m_head{};
+    size_t m_count{};
 };
 
-[[nodiscard]] size_t firstPart(RowsReader& reader)
+[[nodiscard]] size_t firstPart(RowsReader<4>& reader)
 {
-    constexpr auto countArrays = [] (const std::array<char, 4>& input) -> size_t {
-        static constexpr std::array<char, 4> forwardArrays = {'X', 'M', 'A', 'S'};
-        static constexpr std::array<char, 4> backwardArrays = {'S', 'A', 'M', 'X'};
+    static constexpr std::array<char, 4> forward{'X', 'M', 'A', 'S'};
+    static constexpr std::array<char, 4> backward{'S', 'A', 'M', 'X'};
+
+    const auto countWords = [](const std::array<const char*, 4>& data) -> size_t {
+        return std::popcount(simd::match(data, forward)) + std::popcount(simd::match(data, backward));
+    };
+
+    // Columns [col, col + lanes) starting a word in every direction.
+    const auto countBlock = [&](const RowsReader<4>& rows, size_t col) -> size_t {
+        const char* row = rows.newest();
+        size_t count{countWords({row + col, row + col + 1, row + col + 2, row + col + 3})};
+        if(rows.full()) {
+            count += countWords({rows[0] + col, rows[1] + col, rows[2] + col, rows[3] + col});
+            count += countWords({rows[3] + col, rows[2] + col + 1, rows[1] + col + 2, rows[0] + col + 3});
+            count += countWords({rows[0] + col, rows[1] + col + 1, rows[2] + col + 2, rows[3] + col + 3});
+        }
+        return count;
+    };
+
+    // The last columns, where only the vertical word fits.
+    const auto countTail = [&](const RowsReader<4>& rows, size_t col) -> size_t {
+        const auto countColumn = [&](const std::array<const char*, 4>& data) -> size_t {
+            const std::array<char, 4> word{*data[0], *data[1], *data[2], *data[3]};
+            return (word == forward) + (word == backward);
+        };
         size_t count{};
-        count += (forwardArrays == input);
-        count += (backwardArrays == input);
+        if(rows.full()) {
+            count += countColumn({rows[0] + col, rows[1] + col, rows[2] + col, rows[3] + col});
+        }
+        if(col + 3 < rows.width()) {
+            const char* row = rows.newest();
+            count += countColumn({row + col, row + col + 1, row + col + 2, row + col + 3});
+            if(rows.full()) {
+                count += countColumn({rows[3] + col, rows[2] + col + 1, rows[1] + col + 2, rows[0] + col + 3});
+                count += countColumn({rows[0] + col, rows[1] + col + 1, rows[2] + col + 2, rows[3] + col + 3});
+            }
+        }
         return count;
     };
 
     size_t count{};
     while(reader.readNextLine()) {
-        const auto& rows = reader.getRows();
-        const size_t RowSize = rows.back().size();
-        for(size_t i = 0; i < RowSize; ++i) {
-            if(i + 3 < RowSize) {
-                // straightforward
-                if(rows.back().compare(i, 4, "XMAS") == 0) ++count;
-
-                // backward
-                if(rows.back().compare(i, 4, "SAMX") == 0) ++count;
-            }
-
-            if(rows.size() == 4) {
-                // vertical                
-                std::array<char, 4> vertical{rows[3][i], rows[2][i], rows[1][i], rows[0][i]};
-                count += countArrays(vertical);
-
-                if(i + 3 < RowSize) {
-                    std::array<char, 4> bottomUpForwardDiagonal{rows[3][i], rows[2][i + 1], rows[1][i + 2], rows[0][i + 3]};
-                    count += countArrays(bottomUpForwardDiagonal);
-
-                    std::array<char, 4> topDownForwardDiagonal{rows[0][i], rows[1][i + 1], rows[2][i + 2], rows[3][i + 3]};
-                    count += countArrays(topDownForwardDiagonal);
-                }
-            }
+        const size_t RowSize = reader.width();
+        size_t col{};
+        for(; col + simd::gLanes + 3 <= RowSize; col += simd::gLanes) {
+            count += countBlock(reader, col);
+        }
+        for(; col < RowSize; ++col) {
+            count += countTail(reader, col);
         }
     }
     return count;
 }
 
 
-[[nodiscard]] size_t secondPart(RowsReader& reader)
+[[nodiscard]] size_t secondPart(RowsReader<3>& reader)
 {
-    constexpr auto countArrays = [] (const std::array<char, 3>& input) -> size_t {
-        static constexpr std::array forwardArrays = {'M', 'A', 'S'};
-        static constexpr std::array backwardArrays = {'S', 'A', 'M'};
-        size_t count{};
-        count += (forwardArrays == input);
-        count += (backwardArrays == input);
-        return count;
+    // The center is 'A' and both diagonals read MAS or SAM.
+    const auto countBlock = [](const RowsReader<3>& rows, size_t col) -> size_t {
+        const auto diagonal = [](const char* first, const char* last) {
+            return simd::match<2>({first, last}, {'M', 'S'}) | simd::match<2>({first, last}, {'S', 'M'});
+        };
+        const simd::Mask center{simd::equal(rows[1] + col + 1, 'A')};
+        if(center == 0) return 0;
+        return std::popcount(center & diagonal(rows[0] + col, rows[2] + col + 2) & diagonal(rows[2] + col, rows[0] + col + 2));
+    };
+
+    const auto countCell = [](const RowsReader<3>& rows, size_t col) -> size_t {
+        const auto diagonal = [](char first, char last) {
+            return (first == 'M' && last == 'S') || (first == 'S' && last == 'M');
+        };
+        return rows[1][col + 1] == 'A' &&
+            diagonal(rows[0][col], rows[2][col + 2]) &&
+            diagonal(rows[2][col], rows[0][col + 2]);
     };
 
     size_t count{};
     while(reader.readNextLine()) {
-        const auto& rows = reader.getRows();
-        const size_t RowSize = rows.back().size();
-        if(rows.size() < 3) continue;
+        if(!reader.full()) continue;
+
+        const size_t RowSize = reader.width();
+        size_t col{};
+        for(; col + simd::gLanes + 2 <= RowSize; col += simd::gLanes) {
+            count += countBlock(reader, col);
+        }
+        for(; col + 2 < RowSize; ++col) {
+            count += countCell(reader, col);
+        }
+    }
+    return count;
+}
+
+// Aho-Corasick automaton with a dense transition table over the letters used by the dictionary.
+class WordMatcher final
+{
+public:
+    explicit WordMatcher(const std::vector<std::string>& words) {
+        m_symbols.fill(gNoSymbol);
+        for(const auto& word : words) {
+            for(const char ch : word) {
+                auto& symbol = m_symbols[static_cast<unsigned char>(ch)];
+                if(symbol == gNoSymbol) symbol = m_alphabetSize++;
+            }
+        }
 
-        for(size_t i = 0; i + 2 < RowSize; ++i) {
-            std::array<char, 3> forwardDiagonal{rows[2][i], rows[1][i + 1], rows[0][i + 2]};
-            std::array<char, 3> backwardDiagonal{rows[2][i + 2], rows[1][i + 1], rows[0][i]};
+        addState();
+        m_terminals.reserve(words.size());
+        for(const auto& word : words) {
+            if(word.empty()) {
+                throw std::logic_error{"Dictionary words must not be empty"};
+            }
+            uint32_t state{gRoot};
+            for(const char ch : word) {
+                const size_t transition{state * m_alphabetSize + symbol(ch)};
+                if(m_transitions[transition] == gRoot) {
+                    const uint32_t child{addState()};
+                    m_transitions[transition] = child;
+                }
+                state = m_transitions[transition];
+            }
+            m_terminals.push_back(state);
+        }
+        buildFailureLinks();
+    }
+
+    [[nodiscard]] uint32_t root() const noexcept {
+        return gRoot;
+    }
+
+    [[nodiscard]] uint32_t next(uint32_t state, char ch) const noexcept {
+        const uint32_t id{m_symbols[static_cast<unsigned char>(ch)]};
+        return id == gNoSymbol ? gRoot : m_transitions[state * m_alphabetSize + id];
+    }
+
+    // Turns the number of visits of every state into the number of occurrences of every word.
+    [[nodiscard]] std::vector<size_t> countWords(std::vector<size_t> visits) const {
+        // A visit of a state is an occurrence of every word ending in its failure chain.
+        for(auto it = m_order.rbegin(); it != m_order.rend(); ++it) {
+            visits[m_failure[*it]] += visits[*it];
+        }
+        std::vector<size_t> counts;
+        counts.reserve(m_terminals.size());
+        for(const auto terminal : m_terminals) {
+            counts.push_back(visits[terminal]);
+        }
+        return counts;
+    }
+
+    [[nodiscard]] size_t numOfStates() const noexcept {
+        return m_failure.size();
+    }
 
-            if(countArrays(forwardDiagonal) > 0 && countArrays(backwardDiagonal) > 0) {
-                ++count;
+private:
+    static constexpr uint32_t gRoot{0};
+    static constexpr uint32_t gNoSymbol{std::numeric_limits<uint32_t>::max()};
+
+    [[nodiscard]] uint32_t symbol(char ch) const noexcept {
+        return m_symbols[static_cast<unsigned char>(ch)];
+    }
+
+    uint32_t addState() {
+        m_transitions.resize(m_transitions.size() + m_alphabetSize, gRoot);
+        m_failure.push_back(gRoot);
+        return static_cast<uint32_t>(m_failure.size() - 1);
+    }
+
+    // Breadth-first pass that fills missing transitions, so matching never follows failure links.
+    void buildFailureLinks() {
+        std::queue<uint32_t> bfs;
+        for(uint32_t id = 0; id < m_alphabetSize; ++id) {
+            if(const auto child = m_transitions[id]; child != gRoot) {
+                bfs.push(child);
+            }
+        }
+        while(!bfs.empty()) {
+            const uint32_t state{bfs.front()};
+            bfs.pop();
+            m_order.push_back(state);
+            for(uint32_t id = 0; id < m_alphabetSize; ++id) {
+                auto& child = m_transitions[state * m_alphabetSize + id];
+                const uint32_t fallback{m_transitions[m_failure[state] * m_alphabetSize + id]};
+                if(child == gRoot) {
+                    child = fallback;
+                }
+                else {
+                    m_failure[child] = fallback;
+                    bfs.push(child);
+                }
             }
         }
     }
-    return count;
+
+    std::array<uint32_t, 256> m_symbols{};
+    uint32_t m_alphabetSize{};
+    std::vector<uint32_t> m_transitions;
+    std::vector<uint32_t> m_failure;
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_terminals;
+};
+
+[[nodiscard]] std::vector<std::string_view> splitRows(std::string_view input)
+{
+    std::vector<std::string_view> rows;
+    RowsReader<1> reader(input);
+    while(reader.readNextLine()) {
+        rows.emplace_back(reader.newest(), reader.width());
+    }
+    return rows;
+}
+
+[[nodiscard]] std::vector<size_t> countDictionaryWords(const std::vector<std::string_view>& grid, const WordMatcher& matcher)
+{
+    std::vector<size_t> visits(matcher.numOfStates());
+    const int rows{static_cast<int>(grid.size())};
+    const int cols{rows > 0 ? static_cast<int>(grid[0].size()) : 0};
+
+    // Streams the line starting at (row, col) with the given step in both reading directions.
+    const auto streamLine = [&](int row, int col, int rowStep, int colStep) {
+        int length{};
+        for(int r = row, c = col; r >= 0 && r < rows && c >= 0 && c < cols; r += rowStep, c += colStep) {
+            ++length;
+        }
+        uint32_t state{matcher.root()};
+        for(int i = 0; i < length; ++i) {
+            state = matcher.next(state, grid[row + i * rowStep][col + i * colStep]);
+            ++visits[state];
+        }
+        state = matcher.root();
+        for(int i = length - 1; i >= 0; --i) {
+            state = matcher.next(state, grid[row + i * rowStep][col + i * colStep]);
+            ++visits[state];
+        }
+    };
+
+    for(int row = 0; row < rows; ++row) {
+        streamLine(row, 0, 0, 1);
+    }
+    for(int col = 0; col < cols; ++col) {
+        streamLine(0, col, 1, 0);
+    }
+    // Diagonals start on the top row or the left column, anti-diagonals on the top row or the right column.
+    for(int col = 0; col < cols; ++col) {
+        streamLine(0, col, 1, 1);
+        streamLine(0, col, 1, -1);
+    }
+    for(int row = 1; row < rows; ++row) {
+        streamLine(row, 0, 1, 1);
+        streamLine(row, cols - 1, 1, -1);
+    }
+    return matcher.countWords(std::move(visits));
 }
 
 void printHelp()
 {
     std::cerr << "\nUsage:\n"
     << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day4 part1 data/day4.txt";
+    << "\nFor example, ./day4 part1 data/day4.txt"
+    << "\nThe `words` mode takes a dictionary file with one word per line as the third arg."
+    << "\nFor example, ./day4 words data/day4.txt words.txt";
 }
 
 int main(int argc, char* argv[])
 {
-    if(argc != 3) {
+    if(argc < 3) {
         printHelp();
         return 1;
     }
 
     std::string_view task{argv[1]};
-    if(task != "part1" && task != "part2") {
-        std::cerr << "\nfirst arg can be either `part1` or `part2`\n";
-        printHelp();
-        return 1;
+    if(task == "words") {
+        if(argc != 4) {
+            printHelp();
+            return 1;
+        }
+        try {
+            std::vector<std::string> words;
+            readInput(argv[3], std::back_inserter(words));
+            std::erase_if(words, [](const std::string& word) { return word.empty(); });
+
+            const MappedFile file{argv[2]};
+            const WordMatcher matcher{words};
+            const auto counts{countDictionaryWords(splitRows(file.view()), matcher)};
+            for(size_t id = 0; id < words.size(); ++id) {
+                std::cout << words[id] << " " << counts[id] << "\n";
+            }
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "\nexception: " << ex.what();
+            return 1;
+        }
+        return 0;
     }
 
-    std::ifstream ifile(argv[2]);
-    if(!ifile) {
-        std::cerr << "\nFile cannot be open";
+    if(argc != 3 || (task != "part1" && task != "part2")) {
+        std::cerr << "\nfirst arg can be either `part1`, `part2`, or `words`\n";
+        printHelp();
         return 1;
     }
 
-    if(task == "part1") {
-        RowsReader reader(ifile, 4);
-        std::cout << firstPart(reader);
+    try {
+        const MappedFile file{argv[2]};
+        if(task == "part1") {
+            RowsReader<4> reader(file.view());
+            std::cout << firstPart(reader);
+        }
+        else {
+            RowsReader<3> reader(file.view());
+            std::cout << secondPart(reader);
+        }
     }
-    else {
-        RowsReader reader(ifile, 3);
-        std::cout << secondPart(reader);
+    catch(const std::exception& ex) {
+        std::cerr << "\nexception: " << ex.what();
+        return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
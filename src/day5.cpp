@@ -1,88 +1,412 @@
 #include "common_headers.hpp"
-#include <unordered_map>
-#include <unordered_set>
+#include "utils/mapped_file.hpp"
+#include "utils/parallel.hpp"
+
+#include <atomic>
+#include <bitset>
+#include <span>
 #include <sstream>
 
 
-using Graph = std::unordered_map<int, std::unordered_set<int>>;
+// Ordering rules for two-digit page numbers stored as a 100x100 bit matrix.
+class PageRules final
+{
+public:
+    static constexpr int gMaxPages{100};
+
+    [[nodiscard]] static constexpr bool fits(int page) noexcept {
+        return page >= 0 && page < gMaxPages;
+    }
+
+    void addRule(int before, int after) {
+        m_rules[before].set(after);
+    }
+
+    // Update pages are not limited by the rules, so pages outside the matrix are simply unordered.
+    [[nodiscard]] bool precedes(int lhs, int rhs) const noexcept {
+        return fits(lhs) && fits(rhs) && m_rules[lhs][rhs];
+    }
+
+private:
+    std::array<std::bitset<gMaxPages>, gMaxPages> m_rules;
+};
+
+// Dense ids of the pages mentioned by the rules, kept as a sorted list of page numbers.
+// Memory grows with the number of distinct pages, not with the largest page number.
+class PageIds final
+{
+public:
+    static constexpr uint32_t gNoId{std::numeric_limits<uint32_t>::max()};
+
+    explicit PageIds(const std::vector<std::pair<int, int>>& rules) {
+        m_pages.reserve(2 * rules.size());
+        for(const auto& [before, after] : rules) {
+            m_pages.push_back(before);
+            m_pages.push_back(after);
+        }
+        std::ranges::sort(m_pages);
+        const auto duplicates = std::ranges::unique(m_pages);
+        m_pages.erase(duplicates.begin(), duplicates.end());
+    }
+
+    [[nodiscard]] uint32_t size() const noexcept {
+        return static_cast<uint32_t>(m_pages.size());
+    }
+
+    [[nodiscard]] uint32_t id(int page) const noexcept {
+        const auto it{std::ranges::lower_bound(m_pages, page)};
+        return it != m_pages.end() && *it == page ? static_cast<uint32_t>(it - m_pages.begin()) : gNoId;
+    }
+
+private:
+    std::vector<int> m_pages;
+};
+
+// Ordering rules for arbitrary page numbers.
+// Pages mentioned by the rules get dense ids, so the bit matrix is sized by the number of distinct pages
+// rather than by the largest page number.
+class CompressedPageRules final
+{
+public:
+    explicit CompressedPageRules(const std::vector<std::pair<int, int>>& rules) : m_ids{rules}, m_numOfPages{m_ids.size()} {
+        m_words = (m_numOfPages + 63) / 64;
+        m_rules.assign(m_numOfPages * m_words, 0);
+        for(const auto& [before, after] : rules) {
+            const uint32_t afterId{id(after)};
+            m_rules[id(before) * m_words + afterId / 64] |= uint64_t{1} << (afterId % 64);
+        }
+    }
 
+    [[nodiscard]] bool precedes(int lhs, int rhs) const noexcept {
+        const uint32_t lhsId{id(lhs)};
+        const uint32_t rhsId{id(rhs)};
+        if(lhsId == gNoId || rhsId == gNoId) return false;
+        return (m_rules[lhsId * m_words + rhsId / 64] >> (rhsId % 64)) & 1;
+    }
+
+private:
+    static constexpr uint32_t gNoId{PageIds::gNoId};
+
+    [[nodiscard]] uint32_t id(int page) const noexcept {
+        return m_ids.id(page);
+    }
+
+    PageIds m_ids;
+    uint32_t m_numOfPages{};
+    size_t m_words{};
+    std::vector<uint64_t> m_rules;
+};
+
+template<typename Rules>
 struct Comparator final
 {
-    explicit Comparator(const Graph& graph) : m_graph{graph}
+    explicit Comparator(const Rules& rules) : m_rules{rules}
     {}
 
     [[nodiscard]] bool operator()(int lhs, int rhs) const noexcept {
-        return m_graph.find(lhs) != m_graph.end() && m_graph.at(lhs).count(rhs) > 0;
+        return m_rules.precedes(lhs, rhs);
     }
     
 private:
-    const Graph& m_graph;
+    const Rules& m_rules;
 };
 
 
-[[nodiscard]] bool isCorrectPages(const Graph& graph, const std::vector<int>& pages) noexcept
+template<typename Rules>
+[[nodiscard]] bool isCorrectPages(const Rules& rules, const std::vector<int>& pages) noexcept
 {
-    Comparator cmp{graph};
+    Comparator cmp{rules};
     return std::is_sorted(pages.begin(), pages.end(), cmp);
 }
 
-void correctPages(const Graph& graph, std::vector<int>& pages) noexcept
+template<typename Rules>
+void correctPages(const Rules& rules, std::vector<int>& pages) noexcept
 {
-    Comparator cmp{graph};
+    Comparator cmp{rules};
     std::sort(pages.begin(), pages.end(), cmp);
 }
 
-[[nodiscard]] std::pair<int, int> parsePageRule(const std::string& rule) noexcept
+// Finds the page that would be in the middle after correctPages without reordering the update.
+// When the rules order the update totally, the middle page is the one preceded by exactly half of the others.
+template<typename Rules>
+[[nodiscard]] int findMiddlePage(const Rules& rules, std::vector<int>& pages) noexcept
 {
-    constexpr auto convertCharsToInt = [](char tensDigit, char unitsDigit) {
-        return static_cast<int>(tensDigit-'0') * 10 +
-            static_cast<int>(unitsDigit-'0');
-    };
-    return {convertCharsToInt(rule[0], rule[1]), convertCharsToInt(rule[3], rule[4])};
-}
+    const size_t middle{pages.size() / 2};
+    for(const int page : pages) {
+        size_t predecessors{};
+        for(const int other : pages) {
+            predecessors += rules.precedes(other, page);
+        }
+        if(predecessors == middle) {
+            return page;
+        }
+    }
 
+    // The rules leave some pages unordered, so fall back to a partial sort.
+    std::nth_element(pages.begin(), std::next(pages.begin(), middle), pages.end(), Comparator{rules});
+    return pages[middle];
+}
 
-void printHelp()
+[[nodiscard]] std::pair<int, int> parsePageRule(std::string_view rule)
 {
-    std::cerr << "\nUsage:\n"
-    << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day5 part1 data/day5.txt";
+    // Rule pattern looks like: "47|53".
+    const char* const end = rule.data() + rule.size();
+    int before{};
+    const auto [separator, beforeEc] = std::from_chars(rule.data(), end, before);
+    int after{};
+    if(beforeEc != std::errc() || separator == end || *separator != '|' ||
+        std::from_chars(separator + 1, end, after).ec != std::errc() || before < 0 || after < 0) {
+        throw std::logic_error{"Invalid page rule: " + std::string{rule}};
+    }
+    return {before, after};
 }
 
+// Rule set compiled once for validating a large number of updates.
+// Every page named by the rules gets a dense id.
+// For each page the index keeps two sorted id lists:
+// the pages that must come after it (forbidden predecessors) and the pages that must come before it.
+// Checking an update only visits the rules of its own pages, however large the rule set is.
+class CompiledRuleIndex final
+{
+public:
+    // Per-thread working memory, so validating an update does not allocate.
+    // Stamps tag the first position of every page of the current update with its epoch,
+    // so nothing has to be cleared between updates.
+    struct Scratch final
+    {
+        std::vector<int> pages;
+        std::vector<uint32_t> firstPositions;
+        std::vector<uint32_t> stamps;
+        uint32_t epoch{};
+    };
 
-int main(int argc, char* argv[])
+    explicit CompiledRuleIndex(const std::vector<std::pair<int, int>>& rules) : m_ids{rules}, m_numOfPages{m_ids.size()} {
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        edges.reserve(rules.size());
+        for(const auto& [before, after] : rules) {
+            edges.emplace_back(id(before), id(after));
+        }
+        std::ranges::sort(edges);
+        const auto duplicates = std::ranges::unique(edges);
+        edges.erase(duplicates.begin(), duplicates.end());
+        m_successors = Adjacency{edges, m_numOfPages};
+
+        for(auto& [before, after] : edges) {
+            std::swap(before, after);
+        }
+        std::ranges::sort(edges);
+        m_predecessors = Adjacency{edges, m_numOfPages};
+    }
+
+    [[nodiscard]] Scratch makeScratch() const {
+        return Scratch{
+            .pages = {},
+            .firstPositions = std::vector<uint32_t>(m_numOfPages),
+            .stamps = std::vector<uint32_t>(m_numOfPages),
+            .epoch = 0
+        };
+    }
+
+    [[nodiscard]] bool precedes(int lhs, int rhs) const noexcept {
+        const uint32_t lhsId{id(lhs)};
+        const uint32_t rhsId{id(rhs)};
+        return lhsId != gNoId && rhsId != gNoId && std::ranges::binary_search(m_successors.of(lhsId), rhsId);
+    }
+
+    // A page is misplaced if a page that must follow it appears earlier in the update.
+    [[nodiscard]] bool isCorrect(std::span<const int> pages, Scratch& scratch) const noexcept {
+        stamp(pages, scratch);
+        for(uint32_t position = 0; position < pages.size(); ++position) {
+            const uint32_t pageId{id(pages[position])};
+            if(pageId == gNoId) continue;
+
+            for(const uint32_t successor : m_successors.of(pageId)) {
+                if(scratch.stamps[successor] == scratch.epoch && scratch.firstPositions[successor] < position) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Middle page of the corrected update: the page preceded by exactly half of the other pages.
+    [[nodiscard]] int middlePage(std::span<int> pages, Scratch& scratch) const noexcept {
+        stamp(pages, scratch);
+
+        const size_t middle{pages.size() / 2};
+        for(const int page : pages) {
+            const uint32_t pageId{id(page)};
+            size_t predecessors{};
+            if(pageId != gNoId) {
+                for(const uint32_t predecessor : m_predecessors.of(pageId)) {
+                    predecessors += scratch.stamps[predecessor] == scratch.epoch;
+                }
+            }
+            if(predecessors == middle) {
+                return page;
+            }
+        }
+
+        // The rules leave some pages unordered, so fall back to a partial sort.
+        std::nth_element(pages.begin(), std::next(pages.begin(), middle), pages.end(), Comparator{*this});
+        return pages[middle];
+    }
+
+private:
+    static constexpr uint32_t gNoId{PageIds::gNoId};
+
+    // Neighbour lists of all pages in one array, sorted by page id and then by neighbour id.
+    class Adjacency final
+    {
+    public:
+        Adjacency() = default;
+
+        Adjacency(const std::vector<std::pair<uint32_t, uint32_t>>& sortedEdges, uint32_t numOfPages)
+        : m_starts(size_t{numOfPages} + 1)
+        {
+            m_neighbours.reserve(sortedEdges.size());
+            for(const auto& [from, to] : sortedEdges) {
+                ++m_starts[from + 1];
+                m_neighbours.push_back(to);
+            }
+            std::partial_sum(m_starts.begin(), m_starts.end(), m_starts.begin());
+        }
+
+        [[nodiscard]] std::span<const uint32_t> of(uint32_t page) const noexcept {
+            return std::span{m_neighbours}.subspan(m_starts[page], m_starts[page + 1] - m_starts[page]);
+        }
+
+    private:
+        std::vector<uint32_t> m_starts;
+        std::vector<uint32_t> m_neighbours;
+    };
+
+    [[nodiscard]] uint32_t id(int page) const noexcept {
+        return m_ids.id(page);
+    }
+
+    // Records where every page of the update first appears. Stamps of earlier updates become stale with the new epoch.
+    void stamp(std::span<const int> pages, Scratch& scratch) const noexcept {
+        if(++scratch.epoch == 0) {
+            std::ranges::fill(scratch.stamps, 0);
+            scratch.epoch = 1;
+        }
+        for(uint32_t position = 0; position < pages.size(); ++position) {
+            const uint32_t pageId{id(pages[position])};
+            if(pageId != gNoId && scratch.stamps[pageId] != scratch.epoch) {
+                scratch.stamps[pageId] = scratch.epoch;
+                scratch.firstPositions[pageId] = position;
+            }
+        }
+    }
+
+    PageIds m_ids;
+    uint32_t m_numOfPages{};
+    Adjacency m_successors;
+    Adjacency m_predecessors;
+};
+
+// Parses comma separated page numbers in place. Returns false on malformed input.
+[[nodiscard]] bool parseUpdate(std::string_view line, std::vector<int>& pages) noexcept
 {
-    if(argc != 3) {
-        printHelp();
-        return 1;
+    pages.clear();
+    const char* it = line.data();
+    const char* const end = line.data() + line.size();
+    while(it < end) {
+        int page{};
+        const auto [next, ec] = std::from_chars(it, end, page);
+        if(ec != std::errc() || (next != end && *next != ',')) {
+            return false;
+        }
+        pages.push_back(page);
+        it = next + 1;
     }
+    return true;
+}
 
-    std::string_view task{argv[1]};
-    if(task != "part1" && task != "part2") {
-        std::cerr << "\nfirst arg can be either `part1` or `part2`\n";
-        printHelp();
-        return 1;
+// Cuts the next line off the input, without the line break.
+[[nodiscard]] std::string_view nextLine(std::string_view& input) noexcept
+{
+    const size_t end{std::min(input.find('\n'), input.size())};
+    std::string_view line{input.substr(0, end)};
+    input.remove_prefix(std::min(end + 1, input.size()));
+    if(!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
     }
+    return line;
+}
 
-    std::ifstream ifile(argv[2]);
-    if(!ifile) {
-        std::cerr << "\nFile cannot be open";
-        return 1;
+// Validates the updates section of the input on all cores.
+// The section is split into blocks at line boundaries and every worker reuses its own scratch memory.
+[[nodiscard]] size_t solveBulk(const CompiledRuleIndex& index, std::string_view updates, bool fixIncorrect)
+{
+    constexpr size_t minBlockSize{1 << 16};
+    const size_t workers{hardwareThreads()};
+    const size_t blocks{std::clamp<size_t>(updates.size() / minBlockSize, 1, workers * 8)};
+    const size_t blockSize{(updates.size() + blocks - 1) / blocks};
+
+    // A block owns every line that starts inside it.
+    const auto lineStart = [&](size_t pos) {
+        if(pos == 0 || pos >= updates.size()) return std::min(pos, updates.size());
+        return std::min(updates.find('\n', pos - 1), updates.size() - 1) + 1;
+    };
+
+    std::vector<CompiledRuleIndex::Scratch> scratches;
+    for(size_t worker = 0; worker < workers; ++worker) {
+        scratches.push_back(index.makeScratch());
     }
+    std::vector<size_t> sums(blocks);
+    std::atomic<bool> malformed{false};
 
-    Graph graph;
+    parallelFor(blocks, [&](size_t block, size_t worker) {
+        auto& scratch = scratches[worker];
+        const size_t first{lineStart(block * blockSize)};
+        std::string_view lines{updates.substr(first, lineStart((block + 1) * blockSize) - first)};
 
-    std::string line;
-    while(std::getline(ifile, line, '\n')) {
+        size_t sum{};
+        while(!lines.empty()) {
+            const std::string_view line{nextLine(lines)};
+            if(line.empty()) continue;
+
+            if(!parseUpdate(line, scratch.pages)) {
+                malformed = true;
+                return;
+            }
+            const bool correct{index.isCorrect(scratch.pages, scratch)};
+            if(!fixIncorrect && correct) {
+                sum += scratch.pages[scratch.pages.size() / 2];
+            }
+            else if(fixIncorrect && !correct) {
+                sum += index.middlePage(scratch.pages, scratch);
+            }
+        }
+        sums[block] = sum;
+    }, workers);
+
+    if(malformed) {
+        throw std::logic_error{"Invalid page update"};
+    }
+    return std::accumulate(sums.begin(), sums.end(), size_t{});
+}
+
+[[nodiscard]] size_t solveBulk(std::string_view input, bool fixIncorrect)
+{
+    std::vector<std::pair<int, int>> rules;
+    while(!input.empty()) {
+        const std::string_view line{nextLine(input)};
         if(line.empty()) {
             break;
         }
-        
-        const auto [beforeNum, afterNum] = parsePageRule(line);
-        graph[beforeNum].emplace(afterNum);
+        rules.push_back(parsePageRule(line));
     }
+    return solveBulk(CompiledRuleIndex{rules}, input, fixIncorrect);
+}
 
+template<typename Rules>
+[[nodiscard]] size_t solve(const Rules& rules, std::string_view task, std::ifstream& ifile)
+{
     size_t ans{};
+    std::string line;
     std::vector<int> pages;
     while((ifile >> line)) {
         std::stringstream ss(line);
@@ -93,20 +417,98 @@ int main(int argc, char* argv[])
         }
 
         if(task == "part1") {
-            if(isCorrectPages(graph, pages)) {
+            if(isCorrectPages(rules, pages)) {
                 ans += pages[pages.size() / 2];
             }
         }
-        else {
-            if(!isCorrectPages(graph, pages)) {
-                correctPages(graph, pages);
+        else if(task == "part2") {
+            if(!isCorrectPages(rules, pages)) {
+                correctPages(rules, pages);
                 ans += pages[pages.size() / 2];
             }
         }
+        else {
+            if(!isCorrectPages(rules, pages)) {
+                ans += findMiddlePage(rules, pages);
+            }
+        }
+    }
+    return ans;
+}
+
 
+void printHelp()
+{
+    std::cerr << "\nUsage:\n"
+    << "The program requires 2 args: (part1, part2) and the path to the file."
+    << "\nFor example, ./day5 part1 data/day5.txt"
+    << "\n`part2_median` solves part 2 by selecting the middle page instead of sorting the update."
+    << "\n`part1_bulk` and `part2_bulk` validate the updates in parallel against a compiled rule index.";
+}
+
+
+int main(int argc, char* argv[])
+{
+    if(argc != 3) {
+        printHelp();
+        return 1;
+    }
+
+    std::string_view task{argv[1]};
+    if(task == "part1_bulk" || task == "part2_bulk") {
+        try {
+            const MappedFile file{argv[2]};
+            std::cout << solveBulk(file.view(), task == "part2_bulk");
+        }
+        catch(const std::exception& ex) {
+            std::cerr << "\nexception: " << ex.what();
+            return 1;
+        }
+        return 0;
     }
 
-    std::cout << ans;
+    if(task != "part1" && task != "part2" && task != "part2_median") {
+        std::cerr << "\nfirst arg can be either `part1`, `part2`, `part2_median`, `part1_bulk`, or `part2_bulk`\n";
+        printHelp();
+        return 1;
+    }
+
+    std::ifstream ifile(argv[2]);
+    if(!ifile) {
+        std::cerr << "\nFile cannot be open";
+        return 1;
+    }
+
+    try {
+        std::vector<std::pair<int, int>> rules;
+        bool twoDigitPages{true};
+
+        std::string line;
+        while(std::getline(ifile, line, '\n')) {
+            if(line.empty()) {
+                break;
+            }
+            
+            const auto [beforeNum, afterNum] = parsePageRule(line);
+            rules.emplace_back(beforeNum, afterNum);
+            twoDigitPages = twoDigitPages && PageRules::fits(beforeNum) && PageRules::fits(afterNum);
+        }
+
+        if(twoDigitPages) {
+            PageRules pageRules;
+            for(const auto& [before, after] : rules) {
+                pageRules.addRule(before, after);
+            }
+            std::cout << solve(pageRules, task, ifile);
+        }
+        else {
+            std::cout << solve(CompressedPageRules{rules}, task, ifile);
+        }
+    }
+    catch(const std::exception& ex) {
+        std::cerr << "\nexception: " << ex.what();
+        return 1;
+    }
     
     return 0;
-}
\ No newline at end of file
+}
@@ -1,9 +1,9 @@
 #include "common_headers.hpp"
 #include "Cursor.hpp"
+#include "utils/parallel.hpp"
 
+#include <limits>
 #include <tuple>
-#include <set>
-#include <unordered_set>
 
 
 using Graph = std::vector<std::string>;
@@ -25,130 +25,275 @@ std::tuple<Cursor::Direction, int, int> findInitialPosition(const Graph& graph)
 }
 
 
-template<typename TGraph>
-[[nodiscard]] constexpr size_t solveFirstPart(TGraph& graph)
+// For every cell and direction, the cell where a guard moving that way stops,
+// i.e. the last free cell before the next obstacle. Moves that leave the map end at gExit.
+// Only free cells next to an obstacle can be stops; they also get dense ids.
+class JumpTable final
 {
-    auto [direction, row, col] = findInitialPosition(graph);
-    Cursor cursor{direction, row, col};
-    size_t moves{};
-    while(cursor.x() < graph.size() && cursor.y() < graph[0].size() && cursor.x() >= 0 && cursor.y() >= 0) {
-        const auto c{graph[cursor.x()][cursor.y()]};
-        
-        if(c == '#') {
-            cursor.stepBack();
-            cursor.turnRight();
+public:
+    static constexpr uint32_t gExit{std::numeric_limits<uint32_t>::max()};
+    static constexpr uint32_t gNoStop{std::numeric_limits<uint32_t>::max()};
+
+    explicit JumpTable(const Graph& graph)
+    : m_rows{static_cast<uint32_t>(graph.size())}
+    , m_cols{static_cast<uint32_t>(graph.empty() ? 0 : graph[0].size())}
+    , m_stops(size_t{m_rows} * m_cols * 4, gExit)
+    , m_stopIds(size_t{m_rows} * m_cols, gNoStop)
+    {
+        const auto blocked = [&](uint32_t row, uint32_t col) {
+            return row < m_rows && col < m_cols && graph[row][col] == '#';
+        };
+        for(uint32_t row = 0; row < m_rows; ++row) {
+            for(uint32_t col = 0; col < m_cols; ++col) {
+                if(graph[row][col] == '#') continue;
+                if(blocked(row - 1, col) || blocked(row + 1, col) || blocked(row, col - 1) || blocked(row, col + 1)) {
+                    m_stopIds[index(row, col)] = m_numOfStops++;
+                }
+            }
+        }
+
+        for(uint32_t col = 0; col < m_cols; ++col) {
+            uint32_t stop{gExit};
+            for(uint32_t row = 0; row < m_rows; ++row) {
+                if(graph[row][col] == '#') stop = index(row + 1, col);
+                else setStop(index(row, col), Cursor::Direction::Up, stop);
+            }
+            stop = gExit;
+            for(uint32_t row = m_rows; row-- > 0;) {
+                if(graph[row][col] == '#') stop = index(row - 1, col);
+                else setStop(index(row, col), Cursor::Direction::Down, stop);
+            }
+        }
+        for(uint32_t row = 0; row < m_rows; ++row) {
+            uint32_t stop{gExit};
+            for(uint32_t col = 0; col < m_cols; ++col) {
+                if(graph[row][col] == '#') stop = index(row, col + 1);
+                else setStop(index(row, col), Cursor::Direction::Left, stop);
+            }
+            stop = gExit;
+            for(uint32_t col = m_cols; col-- > 0;) {
+                if(graph[row][col] == '#') stop = index(row, col - 1);
+                else setStop(index(row, col), Cursor::Direction::Right, stop);
+            }
         }
-        else {
-            moves += c != 'X';
-            graph[cursor.x()][cursor.y()] = 'X';
-            cursor.move();
+    }
+
+    [[nodiscard]] uint32_t next(uint32_t cell, Cursor::Direction direction) const noexcept {
+        return m_stops[size_t{cell} * 4 + static_cast<uint32_t>(direction)];
+    }
+
+    // The border cell reached when a move leaves the map.
+    [[nodiscard]] uint32_t edge(uint32_t cell, Cursor::Direction direction) const noexcept {
+        switch(direction)
+        {
+        case Cursor::Direction::Up:
+            return column(cell);
+        case Cursor::Direction::Down:
+            return index(m_rows - 1, column(cell));
+        case Cursor::Direction::Left:
+            return index(row(cell), 0);
+        default:
+            return index(row(cell), m_cols - 1);
         }
     }
-    return moves;
-}
 
-template<typename TGraph>
-[[nodiscard]] constexpr size_t solveSecondPart(TGraph& graph)
+    [[nodiscard]] uint32_t index(uint32_t row, uint32_t col) const noexcept {
+        return row * m_cols + col;
+    }
+
+    [[nodiscard]] uint32_t row(uint32_t cell) const noexcept {
+        return cell / m_cols;
+    }
+
+    [[nodiscard]] uint32_t column(uint32_t cell) const noexcept {
+        return cell % m_cols;
+    }
+
+    [[nodiscard]] uint32_t cols() const noexcept {
+        return m_cols;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return size_t{m_rows} * m_cols;
+    }
+
+    [[nodiscard]] uint32_t stopId(uint32_t cell) const noexcept {
+        return m_stopIds[cell];
+    }
+
+    [[nodiscard]] uint32_t numOfStops() const noexcept {
+        return m_numOfStops;
+    }
+
+private:
+    void setStop(uint32_t cell, Cursor::Direction direction, uint32_t stop) noexcept {
+        m_stops[size_t{cell} * 4 + static_cast<uint32_t>(direction)] = stop;
+    }
+
+    uint32_t m_rows{};
+    uint32_t m_cols{};
+    std::vector<uint32_t> m_stops;
+    std::vector<uint32_t> m_stopIds;
+    uint32_t m_numOfStops{};
+};
+
+// Walks the guard from turn to turn and marks every cell of the path.
+// Stops when the guard leaves the map or comes back to a turn it has already made.
+[[nodiscard]] std::vector<uint8_t> tracePath(const JumpTable& table, const Cursor& start)
 {
-    std::set<std::tuple<int, int, Cursor::Direction>> unique;
-    enum Dirs : char {
-        Up = 1 << 0,
-        Down = 1 << 1,
-        Left = 1 << 2,
-        Right = 1 << 3,
-    };
+    std::vector<uint8_t> visited(table.size());
+    std::vector<uint8_t> turns(table.size() * 4);
 
-    auto set_char = [](char& c, char new_val) {
-        if(c == '.') c = 0;
-        c |= new_val;
+    // Segments are straight, so rows are filled as ranges and columns with a stride.
+    const auto markSegment = [&](uint32_t from, uint32_t to) {
+        const uint32_t first{std::min(from, to)};
+        const uint32_t last{std::max(from, to)};
+        const uint32_t stride{table.row(first) == table.row(last) ? 1 : table.cols()};
+        for(uint32_t cell = first; cell <= last; cell += stride) {
+            visited[cell] = 1;
+        }
     };
 
-    auto [direction, row1, col1] = findInitialPosition(graph);
-    graph[row1][col1] = '.';
-    Cursor cursor{direction, row1, col1};
-    size_t moves{};
-    while(cursor.x() < graph.size() && cursor.y() < graph[0].size() && cursor.x() >= 0 && cursor.y() >= 0) {
-        const auto curChar{graph[cursor.x()][cursor.y()]};
-        
-        if(curChar == '#') {
-            cursor.stepBack();
-            cursor.turnRight();
+    Cursor cursor{start};
+    uint32_t cell{table.index(start.x(), start.y())};
+    while(true) {
+        const uint32_t stop{table.next(cell, cursor.direction())};
+        if(stop == JumpTable::gExit) {
+            markSegment(cell, table.edge(cell, cursor.direction()));
+            break;
         }
-        else {
-            switch (cursor.direction())
+        markSegment(cell, stop);
+
+        auto& turn = turns[size_t{stop} * 4 + static_cast<uint32_t>(cursor.direction())];
+        if(turn) break;
+        turn = 1;
+
+        cell = stop;
+        cursor.turnRight();
+    }
+    return visited;
+}
+
+[[nodiscard]] size_t solveFirstPart(const Graph& graph)
+{
+    const auto [direction, row, col] = findInitialPosition(graph);
+    const JumpTable table{graph};
+    const auto visited{tracePath(table, Cursor{direction, row, col})};
+    return std::count(visited.begin(), visited.end(), uint8_t{1});
+}
+
+// Loop check for one extra obstruction. Reused by a worker for all of its candidates.
+// Turns are only recorded at stops: the table's stop cells, plus the cells in front of the obstruction,
+// which take the ids after them. A cell in front of the obstruction is never a table stop in the same direction,
+// because the obstruction was a free cell.
+class LoopDetector final
+{
+public:
+    explicit LoopDetector(const JumpTable& table)
+    : m_table{table}
+    , m_turns((size_t{table.numOfStops()} + 1) * 4)
+    {}
+
+    // Returns true if the guard starting at `start` never leaves the map once `obstruction` is blocked.
+    [[nodiscard]] bool loops(const Cursor& start, uint32_t obstruction) {
+        // Turns recorded for previous candidates become stale by bumping the epoch.
+        if(++m_epoch == 0) {
+            std::fill(m_turns.begin(), m_turns.end(), 0);
+            m_epoch = 1;
+        }
+
+        const uint32_t obstructionRow{m_table.row(obstruction)};
+        const uint32_t obstructionCol{m_table.column(obstruction)};
+
+        Cursor cursor{start};
+        uint32_t cell{m_table.index(start.x(), start.y())};
+        while(true) {
+            const auto direction{cursor.direction()};
+            uint32_t stop{m_table.next(cell, direction)};
+            const uint32_t end{stop == JumpTable::gExit ? m_table.edge(cell, direction) : stop};
+            const uint32_t row{m_table.row(cell)};
+            const uint32_t col{m_table.column(cell)};
+
+            // The extra obstruction cuts the segment short if it lies between the cell and the stop.
+            switch(direction)
             {
-            case Cursor::Direction::Right:
-                if(cursor.x() > 0 && graph[cursor.x() - 1][cursor.y()] == '#') {
-                    for(int r = cursor.x(); r < graph.size() && graph[r][cursor.y()] != '#'; ++r) {
-                        set_char(graph[r][cursor.y()], Dirs::Up);
-                    }
+            case Cursor::Direction::Up:
+                if(obstructionCol == col && obstructionRow < row && obstructionRow >= m_table.row(end)) {
+                    stop = obstruction + m_table.cols();
                 }
                 break;
-            case Cursor::Direction::Left:
-                if(cursor.x() + 1 < graph.size() && graph[cursor.x() + 1][cursor.y()] == '#') {
-                    for(int r = cursor.x(); r >= 0 && graph[r][cursor.y()] != '#'; --r) {
-                        set_char(graph[r][cursor.y()], Dirs::Down);
-                    }
+            case Cursor::Direction::Down:
+                if(obstructionCol == col && obstructionRow > row && obstructionRow <= m_table.row(end)) {
+                    stop = obstruction - m_table.cols();
                 }
                 break;
-            case Cursor::Direction::Up:
-                if(cursor.y() > 0 && graph[cursor.x()][cursor.y() - 1] == '#') {
-                    for(int col = cursor.y(); col < graph[0].size() && graph[cursor.x()][col] != '#'; ++col) {
-                        set_char(graph[cursor.x()][col], Dirs::Left);
-                    }
+            case Cursor::Direction::Left:
+                if(obstructionRow == row && obstructionCol < col && obstructionCol >= m_table.column(end)) {
+                    stop = obstruction + 1;
                 }
                 break;
-            case Cursor::Direction::Down:
-                if(cursor.y() + 1 < graph[0].size() && graph[cursor.x()][cursor.y() + 1] == '#') {
-                    for(int col = cursor.y(); col >= 0 && graph[cursor.x()][col] != '#'; --col) {
-                        set_char(graph[cursor.x()][col], Dirs::Right);
-                    }
+            default:
+                if(obstructionRow == row && obstructionCol > col && obstructionCol <= m_table.column(end)) {
+                    stop = obstruction - 1;
                 }
-                break; 
+                break;
             }
 
-            if(curChar != '.') {
-                switch (cursor.direction())
-                {
-                case Cursor::Direction::Right:
-                    if(curChar & Dirs::Down) {
-                        ++moves;
-                        unique.emplace(cursor.x(), cursor.y(), cursor.direction());
-                        std::cerr << "\nhit right: " << cursor.x() << " " << cursor.y();
-                    }
-                    break;
-                case Cursor::Direction::Up:
-                    if(curChar & Dirs::Right) {
-                        ++moves;
-                        unique.emplace(cursor.x(), cursor.y(), cursor.direction());
-
-                        std::cerr << "\nhit up: " << cursor.x() << " " << cursor.y();
-                    }
-                    break;
-                case Cursor::Direction::Down:
-                    if(curChar & Dirs::Left) {
-                        ++moves;
-                        unique.emplace(cursor.x(), cursor.y(), cursor.direction());
-
-                        std::cerr << "\nhit down: " << cursor.x() << " " << cursor.y();
-                    }
-                    break; 
-                case Cursor::Direction::Left:
-                    if(curChar & Dirs::Up) {
-                        ++moves;
-                        unique.emplace(cursor.x(), cursor.y(), cursor.direction());
-
-                        std::cerr << "\nhit left: " << cursor.x() << " " << cursor.y();
-                    }
-                    break;
-                }
+            if(stop == JumpTable::gExit) {
+                return false;
             }
-            
-            cursor.move();
+
+            const uint32_t stopId{stop == m_table.next(cell, direction) ? m_table.stopId(stop) : m_table.numOfStops()};
+            auto& turn = m_turns[size_t{stopId} * 4 + static_cast<uint32_t>(direction)];
+            if(turn == m_epoch) {
+                return true;
+            }
+            turn = m_epoch;
+
+            cell = stop;
+            cursor.turnRight();
         }
     }
-    std::cout << "\nmoves " << moves;
-    return unique.size();
+
+private:
+    const JumpTable& m_table;
+    std::vector<uint32_t> m_turns;
+    uint32_t m_epoch{};
+};
+
+// Every cell of the original path except the start is a candidate for the new obstruction.
+// The candidates are checked independently on all cores.
+[[nodiscard]] size_t solveSecondPart(const Graph& graph)
+{
+    const auto [direction, row, col] = findInitialPosition(graph);
+    const Cursor start{direction, row, col};
+    const JumpTable table{graph};
+
+    auto visited{tracePath(table, start)};
+    visited[table.index(row, col)] = 0;
+    std::vector<uint32_t> candidates;
+    for(uint32_t cell = 0; cell < visited.size(); ++cell) {
+        if(visited[cell]) candidates.push_back(cell);
+    }
+
+    constexpr size_t blockSize{64};
+    const size_t blocks{(candidates.size() + blockSize - 1) / blockSize};
+    const size_t workers{std::min(hardwareThreads(), std::max<size_t>(blocks, 1))};
+    std::vector<LoopDetector> detectors;
+    detectors.reserve(workers);
+    for(size_t worker = 0; worker < workers; ++worker) {
+        detectors.emplace_back(table);
+    }
+    std::vector<size_t> loops(workers);
+
+    parallelFor(blocks, [&](size_t block, size_t worker) {
+        const size_t last{std::min(candidates.size(), (block + 1) * blockSize)};
+        for(size_t id = block * blockSize; id < last; ++id) {
+            loops[worker] += detectors[worker].loops(start, candidates[id]);
+        }
+    }, workers);
+
+    return std::accumulate(loops.begin(), loops.end(), size_t{});
 }
 
 void printHelp()
@@ -192,8 +337,7 @@ int main(int argc, char* argv[])
         std::cout << solveFirstPart(graph);
     }
     else {
-        const auto s = solveSecondPart(graph);
-        std::cout << "\n" << s;
+        std::cout << solveSecondPart(graph);
     }
 
     // for(auto& row : graph) {
@@ -1,44 +1,74 @@
 #include "common_headers.hpp"
 #include "utils/numeric_algorithm.hpp"
+#include "utils/parallel.hpp"
 
 #include <chrono>
 #include <concepts>
 #include <limits>
 #include <functional>
+#include <span>
 #include <sstream>
 
 constexpr std::string_view gInput {
     #include "../data/2024/day7_constexpr.txt"
 };
 
-constexpr size_t gArgumentsSizeMax{100};
-using ArgumentsArray = std::array<int64_t, gArgumentsSizeMax>;
+// Results may have 20 digits, so they and all intermediate values are 128-bit.
+using Number = int128_t;
+
+// Stands for every value that does not fit into Number. It is larger than any result.
+constexpr Number gOverflow{static_cast<Number>(~uint128_t{} >> 1)};
+
+// Equation as seen by the solvers. The arguments stay in the storage the equation was taken from.
 struct Equation
 {
-    int64_t result{};
-    size_t argumentsCount{};
-    ArgumentsArray arguments;
+    Number result{};
+    std::span<const int64_t> arguments;
 };
 
-template<typename T>
-concept IsEquation = std::is_same_v<T, Equation>;
+// Structure-of-arrays storage for equations: the results, one flat pool with the arguments of all equations,
+// and offsets where the arguments of each equation start (with one extra offset for the end of the pool).
+// std::vector containers are used at runtime, std::array ones in constant evaluation.
+template<typename Results, typename Offsets, typename Arguments>
+struct EquationStorage
+{
+    Results results{};
+    Offsets offsets{};
+    Arguments arguments{};
+
+    [[nodiscard]] constexpr size_t size() const noexcept {
+        return std::size(results);
+    }
+
+    [[nodiscard]] constexpr Equation operator[](size_t id) const noexcept {
+        const std::span<const int64_t> pool{arguments};
+        return Equation{
+            .result = results[id],
+            .arguments = pool.subspan(offsets[id], offsets[id + 1] - offsets[id])
+        };
+    }
+};
+
+using Equations = EquationStorage<std::vector<Number>, std::vector<size_t>, std::vector<int64_t>>;
+
+template<size_t N, size_t ArgumentsN>
+using ConstexprEquations = EquationStorage<std::array<Number, N>, std::array<size_t, N + 1>, std::array<int64_t, ArgumentsN>>;
 
 template<typename T>
-concept EquationArray = requires(T a)
+concept EquationArray = requires(const T& a, size_t id)
 {
-    requires IsEquation<std::iter_value_t<decltype(std::begin(std::declval<T&>()))>>;
-    requires std::forward_iterator<decltype(std::begin(std::declval<T&>()))>;
-    requires std::forward_iterator<decltype(std::end(std::declval<T&>()))>;
+    { a.size() } -> std::convertible_to<size_t>;
+    { a[id] } -> std::same_as<Equation>;
 };
 
 // TODO: replace the function with std::from_chairs, that becomes constexpr in C++23.
-[[nodiscard]] constexpr std::pair<int64_t, size_t> parseNumber(std::string_view str) noexcept {
+[[nodiscard]] constexpr std::pair<Number, size_t> parseNumber(std::string_view str) noexcept {
     constexpr auto char_to_int = [](char c) {
         return c - '0';
     };
     
     size_t index{};
-    int64_t result{};
+    Number result{};
     while (index < str.size() && std::isdigit(str[index])) {
         result = result * 10 + char_to_int(str[index]);
         ++index;
@@ -59,24 +89,25 @@ constexpr void skipNonDigits(std::string_view& str) noexcept {
     }
 }
 
-[[nodiscard]] constexpr std::pair<ArgumentsArray, size_t> parseArgumentsEquation(std::string_view& data)
+// Appends the arguments of one equation to the pool. Returns the index past the last stored argument.
+[[nodiscard]] constexpr size_t parseArgumentsEquation(std::string_view& data, auto& arguments, size_t id)
 {
-    size_t id{};
-    ArgumentsArray arguments{};
-    while(id < gArgumentsSizeMax && !data.empty() && data.front() != '\n') {
+    while(!data.empty() && data.front() != '\n') {
         skipNonDigits(data);
         if(data.empty()) break;
 
         const auto [argument, parsedNums] = parseNumber(data);
+        if(id == std::size(arguments)) {
+            throw std::logic_error{"Number of equation arguments exceeds the storage"};
+        }
+        if(argument > std::numeric_limits<int64_t>::max()) {
+            throw std::logic_error{"Equation argument exceeds int64_t"};
+        }
 
-        arguments[id++] = argument;
+        arguments[id++] = static_cast<int64_t>(argument);
         data.remove_prefix(parsedNums);
     }
-    if (id == gArgumentsSizeMax) {
-        throw std::logic_error{"Number of equation arguments exceeds the threshold"};
-    }
-
-    return std::pair{arguments, id};
+    return id;
 }
 
 [[nodiscard]] constexpr size_t numOfEquastions(std::string_view testData) noexcept
@@ -86,7 +117,21 @@ constexpr void skipNonDigits(std::string_view& str) noexcept {
     });
 }
 
-[[nodiscard]] constexpr Equation parseEquation(std::string_view& testData) {
+// Every number in the input is either a result or an argument.
+[[nodiscard]] constexpr size_t numOfArguments(std::string_view testData) noexcept
+{
+    size_t numbers{};
+    bool inNumber{};
+    for(const char ch : testData) {
+        const bool digit{ch >= '0' && ch <= '9'};
+        numbers += digit && !inNumber;
+        inNumber = digit;
+    }
+    return numbers - numOfEquastions(testData);
+}
+
+// Parses the equation `id` into the storage. Returns the index past its last argument in the pool.
+[[nodiscard]] constexpr size_t parseEquation(std::string_view& testData, auto& equations, size_t id, size_t argumentId) {
     // Equestion pattern looks like: "1234: 32 12 12".
     // The first number is result followed by comma.
     // The rest numbers are arguments separated by whitespace.
@@ -95,36 +140,61 @@ constexpr void skipNonDigits(std::string_view& str) noexcept {
         throw std::runtime_error{"invalid input data"};
     }
     testData.remove_prefix(parsedNums + 2);
-    auto [arguments, count] = parseArgumentsEquation(testData);
 
-    Equation equation{
-        .result = result,
-        .argumentsCount = count,
-        .arguments = arguments
-    };
-    return equation;
+    equations.results[id] = result;
+    equations.offsets[id] = argumentId;
+    return parseArgumentsEquation(testData, equations.arguments, argumentId);
 }
 
-[[nodiscard]] constexpr auto parseEquations(std::string_view testData, EquationArray auto& equations) {
+// The storage must be sized for numOfEquastions equations and numOfArguments arguments.
+constexpr void parseEquations(std::string_view testData, auto& equations) {
     size_t index{};
+    size_t argumentId{};
     const auto N{equations.size()};
     while(index < N && !testData.empty()) {
         skipNonDigits(testData);
         if(testData.empty()) break;
 
-        equations[index] = parseEquation(testData);
+        argumentId = parseEquation(testData, equations, index, argumentId);
         ++index;
-    }    
+    }
+    for(; index < N; ++index) {
+        equations.results[index] = 0;
+        equations.offsets[index] = argumentId;
+    }
+    equations.offsets[N] = argumentId;
+}
+
+[[nodiscard]] Equations parseEquations(std::string_view testData) {
+    Equations equations;
+    equations.results.resize(numOfEquastions(testData));
+    equations.offsets.resize(equations.results.size() + 1);
+    equations.arguments.resize(numOfArguments(testData));
+    parseEquations(testData, equations);
+    return equations;
+}
+
+// Checked arithmetic. A result that does not fit saturates to gOverflow, which stops the search.
+[[nodiscard]] constexpr Number checkedAdd(Number a, Number b) noexcept
+{
+    Number result{};
+    return __builtin_add_overflow(a, b, &result) ? gOverflow : result;
+}
+
+[[nodiscard]] constexpr Number checkedMultiply(Number a, Number b) noexcept
+{
+    Number result{};
+    return __builtin_mul_overflow(a, b, &result) ? gOverflow : result;
 }
 
-[[nodiscard]] constexpr int64_t cat(int64_t a, int64_t b) noexcept
+[[nodiscard]] constexpr Number cat(Number a, Number b) noexcept
 {
-    const int multiplier = std::pow(10, numOfDigits(b));
-    return a * multiplier + b;
+    const auto multiplier = static_cast<Number>(powerOfTen<uint128_t>(numOfDigits(static_cast<uint128_t>(b))));
+    return checkedAdd(checkedMultiply(a, multiplier), b);
 };
 
 template<typename T>
-concept OperatorInvocable = std::regular_invocable<T, int64_t, int64_t>;
+concept OperatorInvocable = std::regular_invocable<T, Number, Number>;
 
 template<typename ...Operations>
 requires (OperatorInvocable<Operations> && ...)
@@ -133,13 +203,15 @@ class Combiner final
 public:
     constexpr explicit Combiner(Operations&& ...operations) : m_operations{std::forward<Operations>(operations)...} {}
 
-    [[nodiscard]] constexpr bool compute(const Equation& equation, size_t id, int64_t curValue) const {
-        if(curValue >= equation.result) {
-            return curValue == equation.result;
-        }
-        if(id >= equation.argumentsCount) {
+    // Arguments are positive, so no operation makes the value smaller and a value above the result is a dead end.
+    // The equation only holds once every argument has been used.
+    [[nodiscard]] constexpr bool compute(const Equation& equation, size_t id, Number curValue) const {
+        if(curValue > equation.result) {
             return false;
         }
+        if(id >= equation.arguments.size()) {
+            return curValue == equation.result;
+        }
 
         return std::apply(
             [&, this](const auto& ...op) {
@@ -150,9 +222,11 @@ public:
     }
 
     [[nodiscard]] constexpr bool compute(const Equation& equation) const {
-        constexpr size_t id{};
-        constexpr size_t initValue{};
-        return compute(equation, id, initValue);
+        if(equation.arguments.empty()) {
+            return false;
+        }
+        constexpr size_t id{1};
+        return compute(equation, id, Number{equation.arguments[0]});
     }
 
 private:
@@ -167,39 +241,131 @@ template<typename ...Operation> requires (OperatorInvocable<Operation> && ...)
 class CatOperation final
 {
 public:
-    constexpr auto operator()(int64_t initValue, int64_t curValue) const noexcept {
+    constexpr auto operator()(Number initValue, Number curValue) const noexcept {
         return cat(initValue, curValue);
     }
 };
 
+class PlusOperation final
+{
+public:
+    constexpr auto operator()(Number initValue, Number curValue) const noexcept {
+        return checkedAdd(initValue, curValue);
+    }
+};
+
+class MultiplyOperation final
+{
+public:
+    constexpr auto operator()(Number initValue, Number curValue) const noexcept {
+        return checkedMultiply(initValue, curValue);
+    }
+};
+
 [[nodiscard]] constexpr bool canBeCombinedBy2Operations(const Equation& equation) {
-    constexpr auto combiner{makeCombiner(std::multiplies<>{}, std::plus<>{})};
+    constexpr auto combiner{makeCombiner(MultiplyOperation{}, PlusOperation{})};
     return combiner.compute(equation);
 }
 
 [[nodiscard]] constexpr bool canBeCombinedBy3Operations(const Equation& equation) {
-    auto combiner{makeCombiner(std::plus<>{}, std::multiplies<>{}, CatOperation{})};
+    auto combiner{makeCombiner(PlusOperation{}, MultiplyOperation{}, CatOperation{})};
     return combiner.compute(equation);
 }
 
+// Searches backwards from the result to the first argument by undoing the last operation at every step.
+// An operation can only be undone if it could have produced the current value,
+// which rules out most branches long before the first argument is reached.
+template<bool WithConcatenation>
+[[nodiscard]] constexpr bool canBeUndone(const Equation& equation, size_t count, Number value)
+{
+    const Number arg{equation.arguments[count - 1]};
+    if(count == 1) {
+        return value == arg;
+    }
+
+    if(arg != 0 && value % arg == 0 && canBeUndone<WithConcatenation>(equation, count - 1, value / arg)) {
+        return true;
+    }
+    if constexpr (WithConcatenation) {
+        const auto multiplier = static_cast<Number>(powerOfTen<uint128_t>(numOfDigits(static_cast<uint128_t>(arg))));
+        if(value > arg && value % multiplier == arg && canBeUndone<WithConcatenation>(equation, count - 1, value / multiplier)) {
+            return true;
+        }
+    }
+    return value > arg && canBeUndone<WithConcatenation>(equation, count - 1, value - arg);
+}
+
+[[nodiscard]] constexpr bool canBeUndoneBy2Operations(const Equation& equation) {
+    return !equation.arguments.empty() && canBeUndone<false>(equation, equation.arguments.size(), equation.result);
+}
+
+[[nodiscard]] constexpr bool canBeUndoneBy3Operations(const Equation& equation) {
+    return !equation.arguments.empty() && canBeUndone<true>(equation, equation.arguments.size(), equation.result);
+}
+
 template<typename CombineFun>
-[[nodiscard]] constexpr size_t solveImpl(const EquationArray auto& equations, const CombineFun& canBeCombined) noexcept
+[[nodiscard]] constexpr Number solveImpl(const EquationArray auto& equations, const CombineFun& canBeCombined)
 {
-    return std::accumulate(std::begin(equations), std::end(equations), size_t{}, [&canBeCombined](size_t value, const Equation& equation) {
-        return canBeCombined(equation) ? value + equation.result : value;
+    const auto solveRange = [&](size_t first, size_t last) {
+        Number value{};
+        for(size_t id = first; id < last; ++id) {
+            const Equation equation{equations[id]};
+            if(canBeCombined(equation)) {
+                value += equation.result;
+            }
+        }
+        return value;
+    };
+
+    if(std::is_constant_evaluated()) {
+        return solveRange(0, equations.size());
+    }
+
+    // The cost of an equation varies a lot, so workers take small blocks from a shared counter.
+    constexpr size_t blockSize{256};
+    const size_t blocks{(equations.size() + blockSize - 1) / blockSize};
+    std::vector<Number> sums(blocks);
+    parallelFor(blocks, [&](size_t block, size_t) {
+        sums[block] = solveRange(block * blockSize, std::min(equations.size(), (block + 1) * blockSize));
     });
+    return std::accumulate(sums.begin(), sums.end(), Number{});
 }
 
-[[nodiscard]] constexpr size_t solveFirstPart(const EquationArray auto& equations) noexcept
+[[nodiscard]] constexpr Number solveFirstPart(const EquationArray auto& equations)
 {
     return solveImpl(equations, canBeCombinedBy2Operations);
 }
 
-[[nodiscard]] constexpr size_t solveSecondPart(const EquationArray auto& equations) noexcept
+[[nodiscard]] constexpr Number solveSecondPart(const EquationArray auto& equations)
 {
     return solveImpl(equations, canBeCombinedBy3Operations);
 }
 
+[[nodiscard]] constexpr Number solveFirstPartReverse(const EquationArray auto& equations)
+{
+    return solveImpl(equations, canBeUndoneBy2Operations);
+}
+
+[[nodiscard]] constexpr Number solveSecondPartReverse(const EquationArray auto& equations)
+{
+    return solveImpl(equations, canBeUndoneBy3Operations);
+}
+
+#if defined(DAY7_CONSTEXPR)
+// Both answers are computed by the compiler from the embedded input.
+// They use the reverse search: the forward Combiner explores up to 3^n assignments per equation,
+// which exceeds the constexpr operation limit on real inputs, and its products may overflow.
+constexpr auto gConstexprEquations = [] {
+    constexpr size_t N{numOfEquastions(gInput)};
+    constexpr size_t ArgumentsN{numOfArguments(gInput)};
+    ConstexprEquations<N, ArgumentsN> equations{};
+    parseEquations(gInput, equations);
+    return equations;
+}();
+constexpr Number gFirstPartConstexprAnswer{solveFirstPartReverse(gConstexprEquations)};
+constexpr Number gSecondPartConstexprAnswer{solveSecondPartReverse(gConstexprEquations)};
+#endif
+
 [[nodiscard]] std::string readFile(std::string_view filename) {
     std::ifstream ifile(filename.data());
     if(!ifile) {
@@ -213,7 +379,10 @@ void printHelp()
 {
     std::cerr << "\nUsage:\n"
     << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day7 part1 data/day7.txt";
+    << "\nFor example, ./day7 part1 data/day7.txt"
+    << "\n`part1_reverse` and `part2_reverse` search backwards from the result instead of combining forwards."
+    << "\n`benchmark` runs both searches for both parts and reports their time."
+    << "\n`part1_constexpr` and `part2_constexpr` print answers computed at compile time (requires DAY7_CONSTEXPR).";
 }
 
 int main(int argc, char* argv[])
@@ -225,49 +394,46 @@ int main(int argc, char* argv[])
 
     std::string_view task{argv[1]};
 
-    if(task == "part1" || task == "part2") {
-        using SolutionImplFunction = size_t(*)(const std::vector<Equation>&);
-        std::unordered_map<std::string_view, SolutionImplFunction> handlers{
-            {"part1", solveFirstPart<std::vector<Equation>>},
-            {"part2", solveSecondPart<std::vector<Equation>>},
-        };
+    using SolutionImplFunction = Number(*)(const Equations&);
+    const std::unordered_map<std::string_view, SolutionImplFunction> handlers{
+        {"part1", solveFirstPart<Equations>},
+        {"part2", solveSecondPart<Equations>},
+        {"part1_reverse", solveFirstPartReverse<Equations>},
+        {"part2_reverse", solveSecondPartReverse<Equations>},
+    };
 
+    if(handlers.count(task) > 0) {
         const auto start = std::chrono::high_resolution_clock::now();
         const auto fileContent{readFile(argv[2])};
-        std::string_view fileContentView{fileContent};
-        const size_t N{numOfEquastions(fileContentView)};
-        std::vector<Equation> equations(N);
-        parseEquations(fileContentView, equations);
+        const auto equations{parseEquations(fileContent)};
 
         const auto res = handlers.at(task)(equations);
         const auto end = std::chrono::high_resolution_clock::now();
 
-        std::cout << res
+        std::cout << toString(res)
         << " elapsed " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count();
     }
-    else if(task == "part1_constexpr") {
-        
+    else if(task == "benchmark") {
+        const auto fileContent{readFile(argv[2])};
+        const auto equations{parseEquations(fileContent)};
+
+        for(const std::string_view name : {"part1", "part1_reverse", "part2", "part2_reverse"}) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            const auto res = handlers.at(name)(equations);
+            const auto end = std::chrono::high_resolution_clock::now();
+            std::cout << "\n" << name << ": " << toString(res)
+            << " elapsed " << std::chrono::duration_cast<std::chrono::microseconds>(end-start).count() << "us";
+        }
+    }
+    else if(task == "part1_constexpr" || task == "part2_constexpr") {
     #if defined(DAY7_CONSTEXPR)
-        const auto constexpr_context = [] {
-            constexpr size_t N{numOfEquastions(gInput)};
-            std::array<Equation, N> equations{};
-            parseEquations(gInput, equations);
-
-            return equations;
-        };
-        constexpr auto equations{constexpr_context()};
-        constexpr auto firstPartAns{solveFirstPart(equations)};
-        std::cout << firstPartAns;
-
-        // TODO: solving second part takes a lot of time and consumes lots of memory.
-        // constexpr auto secondPartAns{solveSecondPart(equations)};
-        // std::cout << "\n" << secondPartAns;
+        std::cout << toString(task == "part1_constexpr" ? gFirstPartConstexprAnswer : gSecondPartConstexprAnswer);
     #else
         std::cout << "\ndisabled. DAY7_CONSTEXPR compile variable should be defined";
     #endif
     }
     else {
-        std::cerr << "\nfirst arg can be either `part1`, `part2`, or `part1_constexpr`\n";
+        std::cerr << "\nfirst arg can be either `part1`, `part2`, `part1_reverse`, `part2_reverse`, `benchmark`, `part1_constexpr`, or `part2_constexpr`\n";
         printHelp();
         return 1;
     }
@@ -1,87 +1,354 @@
 #include "common_headers.hpp"
 #include "Position.hpp"
 #include "utils/input_parser.hpp"
+#include "utils/numeric_algorithm.hpp"
+#include "utils/parallel.hpp"
 
+#include <bit>
+#include <cmath>
+#include <optional>
+#include <tuple>
 
-[[nodiscard]] bool isAntinode(std::vector<std::string>&map, Position position) {
-    return map[position.x][position.y] == '#';
-}
 
-void bookSlotForAntinode(std::vector<std::string>& map, Position position) {
-    map[position.x][position.y] = '#';
-}
+using Antennas = std::unordered_map<char, std::vector<Position>>;
 
-[[nodiscard]] size_t solveFirstPart(std::vector<std::string>& map, const std::unordered_map<char, std::vector<Position>>& antennas) {
-    const size_t rows{map.size()};
-    const size_t cols{map.at(0).size()};
+// One bit per map cell. The input map is never written to, so both parts can share one parse.
+class AntinodeMap final
+{
+public:
+    explicit AntinodeMap(size_t rows, size_t cols) : m_cols{cols}, m_words((rows * cols + 63) / 64) {}
 
-    size_t antinodes{};
-    auto countAntinode = [&](Position position) {
-        if(position.inRange(rows, cols) && !isAntinode(map, position)) {
-            bookSlotForAntinode(map, position);
-            ++antinodes;
+    void mark(Position position) noexcept {
+        const size_t index{static_cast<size_t>(position.x) * m_cols + static_cast<size_t>(position.y)};
+        m_words[index / 64] |= uint64_t{1} << (index % 64);
+    }
+
+    AntinodeMap& operator|=(const AntinodeMap& other) noexcept {
+        for(size_t id = 0; id < m_words.size(); ++id) {
+            m_words[id] |= other.m_words[id];
         }
-    };
+        return *this;
+    }
+
+    [[nodiscard]] size_t count() const noexcept {
+        return std::accumulate(m_words.begin(), m_words.end(), size_t{}, [](size_t sum, uint64_t word) {
+            return sum + static_cast<size_t>(std::popcount(word));
+        });
+    }
 
+private:
+    size_t m_cols{};
+    std::vector<uint64_t> m_words;
+};
+
+// Frequency groups are independent, so they are spread over the workers.
+// Each worker marks into its own map and the maps are OR-ed together at the end.
+template<typename MarkPair>
+[[nodiscard]] size_t countAntinodes(size_t rows, size_t cols, const Antennas& antennas, const MarkPair& markPair) {
+    std::vector<const std::vector<Position>*> groups;
+    groups.reserve(antennas.size());
     for(const auto& [antena, places] : antennas) {
+        groups.push_back(&places);
+    }
+
+    const size_t workers{std::max<size_t>(1, std::min(hardwareThreads(), groups.size()))};
+    std::vector<AntinodeMap> antinodes(workers, AntinodeMap{rows, cols});
+    parallelFor(groups.size(), [&](size_t group, size_t worker) {
+        const auto& places = *groups[group];
         for(size_t i = 0; i < places.size(); ++i) {
-            const Position originPlace{places[i]};
             for(size_t j = i + 1; j < places.size(); ++j) {
-                const int diffX{(originPlace.x - places[j].x) * 2};
-                const int diffY{(originPlace.y - places[j].y) * 2};
-
-                const Position posA{places[j].x + diffX, places[j].y + diffY};
-                countAntinode(posA);
-                const Position posB{originPlace.x - diffX, originPlace.y - diffY};
-                countAntinode(posB);
+                markPair(antinodes[worker], places[i], places[j]);
             }
         }
+    }, workers);
+
+    for(size_t worker = 1; worker < workers; ++worker) {
+        antinodes[0] |= antinodes[worker];
     }
-    return antinodes;
+    return antinodes[0].count();
 }
 
-[[nodiscard]] size_t solveSecondPart(std::vector<std::string>& map, const std::unordered_map<char, std::vector<Position>>& antennas) {
-    const size_t rows{map.size()};
-    const size_t cols{map.at(0).size()};
+[[nodiscard]] size_t solveFirstPart(size_t rows, size_t cols, const Antennas& antennas) {
+    const auto signedRows{static_cast<int64_t>(rows)};
+    const auto signedCols{static_cast<int64_t>(cols)};
+    return countAntinodes(rows, cols, antennas, [&](AntinodeMap& antinodes, Position posA, Position posB) {
+        const int64_t diffX{posA.x - posB.x};
+        const int64_t diffY{posA.y - posB.y};
+
+        const Position antinodeA{posA.x + diffX, posA.y + diffY};
+        if(antinodeA.inRange(signedRows, signedCols)) {
+            antinodes.mark(antinodeA);
+        }
+        const Position antinodeB{posB.x - diffX, posB.y - diffY};
+        if(antinodeB.inRange(signedRows, signedCols)) {
+            antinodes.mark(antinodeB);
+        }
+    });
+}
 
-    size_t antinodes{};
-    auto countAntinode = [&](Position posA, Position posB) {
-        const int diffX{posA.x - posB.x};
-        const int diffY{posA.y - posB.y};
-        Position newPos{posA.x + diffX, posA.y + diffY};
+[[nodiscard]] size_t solveSecondPart(size_t rows, size_t cols, const Antennas& antennas) {
+    const auto signedRows{static_cast<int64_t>(rows)};
+    const auto signedCols{static_cast<int64_t>(cols)};
+    return countAntinodes(rows, cols, antennas, [&](AntinodeMap& antinodes, Position posA, Position posB) {
+        // Every grid point on the line counts, not only multiples of the full distance,
+        // so the line is walked with the smallest integer step.
+        const int64_t divisor{std::gcd(posA.x - posB.x, posA.y - posB.y)};
+        const int64_t stepX{(posA.x - posB.x) / divisor};
+        const int64_t stepY{(posA.y - posB.y) / divisor};
 
-        if(!isAntinode(map, posA)) {
-                bookSlotForAntinode(map, posA);
-                ++antinodes;
+        for(Position pos{posA}; pos.inRange(signedRows, signedCols); pos.x += stepX, pos.y += stepY) {
+            antinodes.mark(pos);
         }
+        for(Position pos{posA.x - stepX, posA.y - stepY}; pos.inRange(signedRows, signedCols); pos.x -= stepX, pos.y -= stepY) {
+            antinodes.mark(pos);
+        }
+    });
+}
 
-        while(newPos.inRange(rows, cols)) {
-            if(!isAntinode(map, newPos)) {
-                bookSlotForAntinode(map, newPos);
-                ++antinodes;
-            }
-            newPos.x += diffX;
-            newPos.y += diffY;
+// Fields with huge coordinates and few antennas. Nothing here depends on the area of the field.
+namespace sparse {
+
+// Input format: a `rows cols` header followed by `frequency x y` lines.
+struct Field
+{
+    int64_t rows{};
+    int64_t cols{};
+    Antennas antennas;
+};
+
+[[nodiscard]] Field readField(std::string_view filename) {
+    std::ifstream ifile(filename.data());
+    if(!ifile) {
+        throw std::runtime_error{"File cannot be open: " + std::string{filename}};
+    }
+
+    Field field;
+    if(!(ifile >> field.rows >> field.cols) || field.rows <= 0 || field.cols <= 0) {
+        throw std::runtime_error{"Invalid field size"};
+    }
+
+    char frequency{};
+    int64_t x{};
+    int64_t y{};
+    while(ifile >> frequency >> x >> y) {
+        const Position position{x, y};
+        if(!position.inRange(field.rows, field.cols)) {
+            throw std::runtime_error{"Antenna out of the field"};
+        }
+        field.antennas[frequency].push_back(position);
+    }
+    return field;
+}
+
+[[nodiscard]] size_t solveFirstPart(const Field& field) {
+    std::vector<Position> antinodes;
+    auto addAntinode = [&](Position position) {
+        if(position.inRange(field.rows, field.cols)) {
+            antinodes.push_back(position);
         }
     };
 
-    for(const auto& [antena, places] : antennas) {
+    for(const auto& [antena, places] : field.antennas) {
+        for(size_t i = 0; i < places.size(); ++i) {
+            for(size_t j = i + 1; j < places.size(); ++j) {
+                if(places[i] == places[j]) continue;
+                const int64_t diffX{places[i].x - places[j].x};
+                const int64_t diffY{places[i].y - places[j].y};
+                addAntinode(Position{places[i].x + diffX, places[i].y + diffY});
+                addAntinode(Position{places[j].x - diffX, places[j].y - diffY});
+            }
+        }
+    }
+
+    std::ranges::sort(antinodes);
+    return static_cast<size_t>(std::distance(antinodes.begin(), std::unique(antinodes.begin(), antinodes.end())));
+}
+
+[[nodiscard]] constexpr int64_t floorDiv(int64_t a, int64_t b) noexcept {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+[[nodiscard]] constexpr int64_t ceilDiv(int64_t a, int64_t b) noexcept {
+    return -floorDiv(-a, b);
+}
+
+// Line through `origin` with the smallest integer step (stepX, stepY).
+// The step is normalized, so two pairs on the same line give the same (stepX, stepY, offset).
+struct Line
+{
+    int64_t stepX{};
+    int64_t stepY{};
+    // stepY * x - stepX * y, the same for every point of the line.
+    int128_t offset{};
+    Position origin;
+
+    explicit Line(Position posA, Position posB) noexcept : origin{posA} {
+        const int64_t divisor{std::gcd(posB.x - posA.x, posB.y - posA.y)};
+        stepX = (posB.x - posA.x) / divisor;
+        stepY = (posB.y - posA.y) / divisor;
+        if(stepX < 0 || (stepX == 0 && stepY < 0)) {
+            stepX = -stepX;
+            stepY = -stepY;
+        }
+        offset = int128_t{stepY} * posA.x - int128_t{stepX} * posA.y;
+    }
+
+    [[nodiscard]] auto key() const noexcept {
+        return std::tuple{stepX, stepY, offset};
+    }
+};
+
+// Range of t, for which 0 <= origin + t * step < limit.
+[[nodiscard]] constexpr std::pair<int64_t, int64_t> stepRange(int64_t origin, int64_t step, int64_t limit) noexcept {
+    if(step == 0) {
+        return {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()};
+    }
+    if(step > 0) {
+        return {ceilDiv(-origin, step), floorDiv(limit - 1 - origin, step)};
+    }
+    return {ceilDiv(limit - 1 - origin, step), floorDiv(-origin, step)};
+}
+
+[[nodiscard]] size_t countLatticePoints(const Field& field, const Line& line) noexcept {
+    const auto [firstX, lastX] = stepRange(line.origin.x, line.stepX, field.rows);
+    const auto [firstY, lastY] = stepRange(line.origin.y, line.stepY, field.cols);
+    // The origin is an antenna inside the field, so t = 0 is always in range.
+    return static_cast<size_t>(std::min(lastX, lastY) - std::max(firstX, firstY) + 1);
+}
+
+[[nodiscard]] std::optional<Position> intersect(const Field& field, const Line& lineA, const Line& lineB) noexcept {
+    // Solves stepY * x - stepX * y = offset for both lines by Cramer's rule.
+    const int128_t det{int128_t{lineA.stepX} * lineB.stepY - int128_t{lineB.stepX} * lineA.stepY};
+    if(det == 0) {
+        return std::nullopt;
+    }
+
+    const int128_t numX{lineB.offset * lineA.stepX - lineA.offset * lineB.stepX};
+    const int128_t numY{lineB.offset * lineA.stepY - lineA.offset * lineB.stepY};
+    if(numX % det != 0 || numY % det != 0) {
+        return std::nullopt;
+    }
+
+    const int128_t x{numX / det};
+    const int128_t y{numY / det};
+    if(x < 0 || x >= field.rows || y < 0 || y >= field.cols) {
+        return std::nullopt;
+    }
+    return Position{static_cast<int64_t>(x), static_cast<int64_t>(y)};
+}
+
+// Lines with at most this many points are cheaper to enumerate than to intersect.
+constexpr size_t gShortLineLimit{4096};
+
+[[nodiscard]] std::vector<Position> latticePoints(const Field& field, const Line& line) {
+    const auto [firstX, lastX] = stepRange(line.origin.x, line.stepX, field.rows);
+    const auto [firstY, lastY] = stepRange(line.origin.y, line.stepY, field.cols);
+    std::vector<Position> points;
+    for(int64_t t = std::max(firstX, firstY); t <= std::min(lastX, lastY); ++t) {
+        points.emplace_back(line.origin.x + t * line.stepX, line.origin.y + t * line.stepY);
+    }
+    return points;
+}
+
+// Sums the lattice points of every distinct long line and then removes the points counted more than once.
+// A point on k lines is found by k * (k - 1) / 2 pairs of lines and has been counted k times.
+// Intersecting all pairs is quadratic in the number of lines, but with huge coordinates most lines hold
+// only a few lattice points. Those short lines are enumerated and only intersected with the long ones
+// to drop the points that the long lines already counted.
+[[nodiscard]] size_t solveSecondPart(const Field& field) {
+    std::vector<Line> lines;
+    for(const auto& [antena, places] : field.antennas) {
         for(size_t i = 0; i < places.size(); ++i) {
-            const Position originPlace{places[i]};
             for(size_t j = i + 1; j < places.size(); ++j) {
-                countAntinode(originPlace, places[j]);
-                countAntinode(places[j], originPlace);
+                if(places[i] != places[j]) {
+                    lines.emplace_back(places[i], places[j]);
+                }
+            }
+        }
+    }
+    std::ranges::sort(lines, {}, &Line::key);
+    const auto duplicates = std::ranges::unique(lines, {}, &Line::key);
+    lines.erase(duplicates.begin(), duplicates.end());
+
+    size_t points{};
+    std::vector<Line> longLines;
+    std::vector<Line> shortLines;
+    for(const auto& line : lines) {
+        const size_t count{countLatticePoints(field, line)};
+        if(count > gShortLineLimit) {
+            points += count;
+            longLines.push_back(line);
+        }
+        else {
+            shortLines.push_back(line);
+        }
+    }
+    lines = {};
+
+    const size_t workers{std::max<size_t>(1, std::min(hardwareThreads(), longLines.size()))};
+    std::vector<std::vector<Position>> crossings(workers);
+    std::vector<std::vector<Position>> covered(workers);
+    parallelFor(longLines.size(), [&](size_t i, size_t worker) {
+        for(size_t j = i + 1; j < longLines.size(); ++j) {
+            if(const auto point{intersect(field, longLines[i], longLines[j])}) {
+                crossings[worker].push_back(*point);
+            }
+        }
+        for(const auto& line : shortLines) {
+            if(const auto point{intersect(field, longLines[i], line)}) {
+                covered[worker].push_back(*point);
             }
         }
+    }, workers);
+
+    const auto merge = [](std::vector<std::vector<Position>>& parts) {
+        std::vector<Position> merged;
+        for(auto& part : parts) {
+            merged.insert(merged.end(), part.begin(), part.end());
+            part = {};
+        }
+        std::ranges::sort(merged);
+        return merged;
+    };
+
+    const auto longLinePoints{merge(crossings)};
+    for(auto it = longLinePoints.begin(); it != longLinePoints.end();) {
+        const auto next{std::find_if(it, longLinePoints.end(), [&](Position position) { return position != *it; })};
+        const auto pairs{static_cast<size_t>(std::distance(it, next))};
+        const size_t lineCount{(1 + static_cast<size_t>(std::sqrt(static_cast<double>(1 + 8 * pairs)))) / 2};
+        if(lineCount * (lineCount - 1) / 2 != pairs) {
+            throw std::logic_error{"Inconsistent number of intersecting lines"};
+        }
+        points -= lineCount - 1;
+        it = next;
+    }
+
+    std::vector<Position> shortLinePoints;
+    for(const auto& line : shortLines) {
+        const auto linePoints{latticePoints(field, line)};
+        shortLinePoints.insert(shortLinePoints.end(), linePoints.begin(), linePoints.end());
     }
-    return antinodes;
+    std::ranges::sort(shortLinePoints);
+    const auto repeated = std::ranges::unique(shortLinePoints);
+    shortLinePoints.erase(repeated.begin(), repeated.end());
+
+    auto coveredPoints{merge(covered)};
+    const auto repeatedCovered = std::ranges::unique(coveredPoints);
+    coveredPoints.erase(repeatedCovered.begin(), repeatedCovered.end());
+
+    // Every covered point lies on a short line, so it is one of the enumerated points.
+    points += shortLinePoints.size() - coveredPoints.size();
+    return points;
 }
 
+} // namespace sparse
+
 void printHelp()
 {
     std::cerr << "\nUsage:\n"
-    << "The program requires 2 args: (part1, part2) and the path to the file."
-    << "\nFor example, ./day7 part1 data/day7.txt";
+    << "The program requires 2 args: (part1, part2, both, sparse_part1, sparse_part2) and the path to the file."
+    << "\nThe sparse tasks read a `rows cols` header followed by `frequency x y` lines."
+    << "\nFor example, ./day8 part1 data/day8.txt";
 }
 
 int main(int argc, char* argv[])
@@ -92,8 +359,20 @@ int main(int argc, char* argv[])
     }
 
     std::string_view task{argv[1]};
-    if(task != "part1" && task != "part2") {
-        std::cerr << "\nfirst arg can be either `part1` or `part2`\n";
+    if(task == "sparse_part1" || task == "sparse_part2") {
+        try {
+            const auto field{sparse::readField(argv[2])};
+            std::cout << (task == "sparse_part1" ? sparse::solveFirstPart(field) : sparse::solveSecondPart(field));
+        }
+        catch(const std::exception& e) {
+            std::cerr << "\n" << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if(task != "part1" && task != "part2" && task != "both") {
+        std::cerr << "\nfirst arg can be either `part1`, `part2`, `both`, `sparse_part1` or `sparse_part2`\n";
         printHelp();
         return 1;
     }
@@ -101,28 +380,31 @@ int main(int argc, char* argv[])
     std::vector<std::string> map;
     readInput(argv[2], std::back_inserter(map));
 
-    std::unordered_map<char, std::vector<Position>> antennas;
+    if(map.empty()) {
+        std::cerr << "\nThe map is empty\n";
+        return 1;
+    }
+
+    Antennas antennas;
     for(size_t id = 0; id < map.size(); ++id) {
         const auto& line = map[id];
         for(size_t cid = 0; cid < line.size(); ++cid) {
             if(line[cid] == '.') continue;
-            antennas[line[cid]].emplace_back(static_cast<int>(id), static_cast<int>(cid));
+            antennas[line[cid]].emplace_back(static_cast<int64_t>(id), static_cast<int64_t>(cid));
         }
     }
 
+    const size_t rows{map.size()};
+    const size_t cols{map.front().size()};
     if(task == "part1") {
-        std::cout << solveFirstPart(map, antennas);
+        std::cout << solveFirstPart(rows, cols, antennas);
     }
-    else {
-        std::cout << solveSecondPart(map, antennas);
+    else if(task == "part2") {
+        std::cout << solveSecondPart(rows, cols, antennas);
     }
-
-    for(auto& r : map) {
-        std::cerr << "\n";
-        for(auto ch : r) {
-            std::cerr << " " << ch;
-        }
+    else {
+        std::cout << solveFirstPart(rows, cols, antennas) << "\n" << solveSecondPart(rows, cols, antennas);
     }
 
     return 0;
-}
\ No newline at end of file
+}